@@ -9,16 +9,35 @@
  
 #include "BTreeIndex.h"
 #include "BTreeNode.h"
+#include <cstring>
+#include <climits>
 #include <iostream>
 
 using namespace std;
 
+int BTreeIndex::fillPercent = BTreeIndex::DEFAULT_FILL_PERCENT;
+int BTreeIndex::nodeReadCount = 0;
+
 /*
  * BTreeIndex constructor
  */
 BTreeIndex::BTreeIndex()
 {
     rootPid = -1;
+    treeHeight = 0;
+    rootDirty = false;
+}
+
+/*
+ * Set how full bulkLoad() packs the nodes.
+ * @param percent[IN] the fill factor of the nodes, 10 to 100
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::setFillPercent(int percent)
+{
+    if(percent < 10 || percent > 100) return RC_INVALID_ATTRIBUTE;
+    fillPercent = percent;
+    return 0;
 }
 
 /*
@@ -32,11 +51,16 @@ RC BTreeIndex::open(const string& indexname, char mode)
 {
     RC rc = pf.open(indexname, mode);
     if(rc < 0) return rc;
+    rootDirty = false;
     switch(mode) {
     case 'r':
     case 'R': 
         // read rootPid and treeHeight
-        return readRootAndHeight();
+        rc = readRootAndHeight();
+        // queries jump between the levels of the tree. range scans read
+        // their leaves ahead on their own
+        if (rc == 0) pf.advise(PageFile::RANDOM);
+        break;
     case 'w':
     case 'W':
     {
@@ -46,13 +70,16 @@ RC BTreeIndex::open(const string& indexname, char mode)
             // set tree height to 0
             treeHeight = 0;
             // write the rootPid and treeHeight into file
-            return writeRootAndHeight();
+            rc = writeRootAndHeight();
         }else
-            return readRootAndHeight();
+            rc = readRootAndHeight();
+        break;
     }
     default:
-        return RC_INVALID_FILE_MODE;
+        rc = RC_INVALID_FILE_MODE;
     }
+    if(rc < 0) pf.close();
+    return rc;
 }
 
 /*
@@ -60,16 +87,20 @@ RC BTreeIndex::open(const string& indexname, char mode)
  * @return error code, 0 if no error
  */
 RC BTreeIndex::writeRootAndHeight() {
-    // create a buffer in main memory
-    char buffer[PageFile::PAGE_SIZE];
-    // initialize buffer to all 0
-    memset(buffer, 0, PageFile::PAGE_SIZE);
+    // create a buffer in main memory, initialized to all 0
+    vector<char> page(pf.getPageSize(), 0);
+    char* buffer = &page[0];
     // make the root pid to be the last page id
     memcpy(buffer, &rootPid, sizeof(PageId));
-    // set the tree height to be 0
+    // set the tree height
     memcpy(buffer + sizeof(PageId), &treeHeight, sizeof(int));
+    // record the node layout the tree is written in
+    int format = NODE_FORMAT;
+    memcpy(buffer + sizeof(PageId) + sizeof(int), &format, sizeof(int));
     // write the buffer to the page file
-    return pf.write(0, buffer);
+    RC rc = pf.write(0, buffer);
+    if(rc == 0) rootDirty = false;
+    return rc;
 }
 
 /*
@@ -78,14 +109,16 @@ RC BTreeIndex::writeRootAndHeight() {
  */
 RC BTreeIndex::readRootAndHeight() {
     RC rc;
-    // create a buffer in main memory
-    char buffer[PageFile::PAGE_SIZE];
-    // read out content from the first page
-    if((rc = pf.read(0, buffer)) < 0) return rc;
+    // pin the first page in the buffer pool
+    PageGuard page;
+    if((rc = pf.fetch(0, page)) < 0) return rc;
     // copy root pid and tree height
-    memcpy(&rootPid, buffer, sizeof(PageId));
-    memcpy(&treeHeight, buffer + sizeof(PageId), sizeof(int));
-    //cout<<"BTreeIndex::readRootAndHeight: rootPid="<<rootPid<<"\ttreeHeight="<<treeHeight<<endl;
+    memcpy(&rootPid, page.data(), sizeof(PageId));
+    memcpy(&treeHeight, page.data() + sizeof(PageId), sizeof(int));
+    // an index in another node layout has to be rebuilt
+    int format;
+    memcpy(&format, page.data() + sizeof(PageId) + sizeof(int), sizeof(int));
+    if(format != NODE_FORMAT) return RC_INVALID_FILE_FORMAT;
     return 0;
 }
 
@@ -95,7 +128,11 @@ RC BTreeIndex::readRootAndHeight() {
  */
 RC BTreeIndex::close()
 {
-    return pf.close();
+    RC rc = 0;
+    // rootPid and treeHeight are written once, when the index is closed
+    if(rootDirty) rc = writeRootAndHeight();
+    RC closeRc = pf.close();
+    return (rc < 0) ? rc : closeRc;
 }
 
 /*
@@ -107,175 +144,224 @@ RC BTreeIndex::close()
 RC BTreeIndex::insert(int key, const RecordId& rid)
 {
     RC rc;
-    char page[PageFile::PAGE_SIZE];
-    PageId nextPid = pf.endPid();
-    //printf("nextpid = %d\n",nextPid);
-    if(nextPid == 1) {// the index file is empty, need initialization
-        //printf("inserting key=%d\n",key);
-        // update rootPid and treeHeight
-        rootPid = nextPid;
+
+    if(treeHeight == 0) { // the index is empty, the first leaf becomes the root
+        rootPid = pf.endPid();
         treeHeight = 1;
-        // create a leaf node as root node
-        BTLeafNode rootNode;
-        // insert key and rid as the first entry
+        rootDirty = true;
+        // create a leaf node as root node with key and rid as the first entry
+        BTLeafNode rootNode(pf.getPageSize());
         rootNode.insert(key, rid);
-        // write to file
-        rootNode.write(nextPid, pf);
-        // update rootPid and treeHeight to file
-        rc = writeRootAndHeight();
-        // testing read from .tbl
-        //printf("key count = %d\n", rootNode.getKeyCount());
-        // read keys
-        for (int i = 0; i < rootNode.getKeyCount(); i ++) {
-            int key;
-            RecordId rid;
-            rootNode.readEntry(i, key, rid);
-            //cout<<i<<"th entry: \t"<<"key = "<<key<<"\trecordId.pid = "<<rid.pid<<"\trecordId.sid"<<rid.sid<<endl;
-        }
-        return 0;
+        return rootNode.write(rootPid, pf);
     }
-    return recursivelyInsert(key, rid, rootPid, treeHeight);
-}
 
-RC BTreeIndex::insertAndSplit(BTLeafNode& currNode, PageId& currPid, int eid, int& key, const RecordId& rid) {
-//    cout<<"BTreeIndex::insertAndSplit currPid="<<currPid<<"\tkey="<<key<<"\tsiblingPid="<<siblingPid<<endl;
-    // need a new leaf node to store the keys
-    BTLeafNode siblingNode;
-    // store the page id of sibling node
-    PageId siblingPid = pf.endPid();
-    // get the returned sibling key
-    int siblingKey;
-    // call insertAndSplit
-    currNode.insertAndSplit(key, rid, eid, siblingNode, siblingKey);
-    // set the next pointer of currNode to siblingNode
-    currNode.setNextNodePtr(siblingPid);
-     //cout<<"BTreeIndex::insertAndSplit nextPid:"<<siblingPid<<endl;
-    // write changes to file
-    currNode.write(currPid, pf);
-    siblingNode.write(siblingPid, pf);
-    //cout<<"BTreeIndex::insertAndSplit nextNodePtr:"<<currNode.getNextNodePtr()<<endl;
-
-    // now we have siblingKey and siblingPid, we can insert it to parent node
-    // cout<<"BTreeIndex::insertAndSplit currentPid:"<<currPid<<endl;
-    // if there is no non-leaf node exists, initialize root
-    if(treeHeight == 1)
-        initializeRoot(currPid, siblingKey, siblingPid);
-    currPid = siblingPid;
-    key = siblingKey;
-}
-
-RC BTreeIndex::insertAndSplit(BTNonLeafNode& currNode, PageId& currPid, int eid, int& key, const PageId& pid) {
-    // need a new non leaf node to store the keys
-    BTNonLeafNode siblingNode;
-    // store the page id of sibling node
-    PageId siblingPid = pf.endPid();
-    // get the returned mid key
-    int midKey;
-    // call insertAndSplit
-    currNode.insertAndSplit(key, pid, eid, siblingNode, midKey);
-    // write changes to file
-    currNode.write(currPid, pf);
-    siblingNode.write(siblingPid, pf);
-    
-    readRootAndHeight();
-    // now we have midKey and siblingPid, we can insert it to parent node
-    // printf("BTreeIndex::insertAndSplit: rootPid = %d\tcurrPid = %d\n",rootPid,currPid);
-    // if we need a new root, initialize a root
-    if(currPid == rootPid)
-        initializeRoot(currPid, midKey, siblingPid);
-    currPid = siblingPid;
-    key = midKey;
-}
+    int size, splitKey, splitSize;
+    PageId splitPid;
+    if((rc = insertInto(rootPid, treeHeight, key, rid, size, splitKey, splitPid, splitSize)) < 0) return rc;
+    if(splitPid < 0) return 0;
 
-RC BTreeIndex::initializeRoot(const PageId& currPid, int key, const PageId& siblingPid) {
-//    cout<<"BTreeIndex::initializeRoot: currPid:"<<currPid<<endl;
-    // create a new non-leaf node as root
-    BTNonLeafNode rootNode;
-    // initialize the root
-    rootNode.initializeRoot(currPid, key, siblingPid);
-    // get a new pid as root pid
+    // the root was split, so the tree grows by one level
+    BTNonLeafNode rootNode(pf.getPageSize());
+    rootNode.initializeRoot(rootPid, size, splitKey, splitPid, splitSize);
     rootPid = pf.endPid();
-//    printf("BTreeIndex::initializeRoot: rootPid = %d\tcurrPid=%d\tkey=%d\n",rootPid,currPid,key);
     treeHeight++;
-    // write changes to file
-    rootNode.write(rootPid, pf);
-    // update root and tree height
-    BTNonLeafNode testNode;
-    testNode.read(rootPid, pf);
-    int key0;
-    PageId pid0;
-    testNode.readEntry(0,key0,pid0);
-    //printf("BTreeIndex::initializeRoot: rootPid = %d\ttreeHeight = %d\n",rootPid, treeHeight);
-    writeRootAndHeight();
+    rootDirty = true;
+    return rootNode.write(rootPid, pf);
 }
 
-RC BTreeIndex::recursivelyInsert(int& searchKey, const RecordId& rid, PageId& pid, int level)
+/*
+ * Insert (key, RecordId) pair into the subtree rooted at pid.
+ * If the node at pid overflows, it is split and the new sibling
+ * is returned in (splitKey, splitPid) for the caller to insert.
+ * @param pid[IN] the root of the subtree
+ * @param level[IN] the height of the subtree. 1 for a leaf node
+ * @param key[IN] the key to insert
+ * @param rid[IN] the RecordId to insert
+ * @param size[OUT] the number of leaf entries under pid after the insert
+ * @param splitKey[OUT] the first key of the new sibling
+ * @param splitPid[OUT] the PageId of the new sibling. -1 if no split
+ * @param splitSize[OUT] the number of leaf entries under the new sibling
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::insertInto(PageId pid, int level, int key, const RecordId& rid,
+                          int& size, int& splitKey, PageId& splitPid, int& splitSize)
 {
-    //printf("inserting key=%d\n",searchKey);
     RC rc;
-    // store current pid
-    PageId currPid = pid;
-    // base case: insert into leaf node
+    splitPid = -1;
+
     if(level == 1) {
-        // this is the leaf level
+        // this is the leaf level. the node is changed in a copy, so that
+        // the frame in the buffer pool stays as it is unless the change
+        // is written
         BTLeafNode leafNode;
-        // read the page into a leaf node
-        if((rc = leafNode.read(pid, pf)) < 0) return rc;
-        // find eid
-        int eid;
-        leafNode.locate(searchKey, eid);
-        //printf("BTreeIndex::recursivelyInsert:eid=%d,\tsearchKey=%d\tKeycount = %d\n",eid,searchKey,leafNode.getKeyCount());
-        // insert the key
-        if(leafNode.getKeyCount() == BTLeafNode::MAX_KEY_NUM) {
-            // need to split
-            insertAndSplit(leafNode, pid, eid, searchKey, rid);
-            //printf("BTreeIndex::recursivelyInsert: siblingPid=%d\tsearchKey=%d\n", pid, searchKey);
-            // read rootPid
-            //readRootAndHeight();
-            // if this level is full, return rc
-            return RC_NODE_FULL;
-        } else {
-            // insert
-            leafNode.insertAtEid(searchKey, rid, eid);
-            // write changes to file
-            leafNode.write(currPid, pf);
-            return 0;
+        if((rc = leafNode.readCopy(pid, pf)) < 0) return rc;
+        if(leafNode.insert(key, rid) == 0) {
+            size = leafNode.getKeyCount();
+            return leafNode.write(pid, pf);
         }
+
+        // the leaf is full. move half of it to a new sibling
+        // that follows it in the leaf chain
+        BTLeafNode sibling(pf.getPageSize());
+        splitPid = pf.endPid();
+        leafNode.insertAndSplit(key, rid, sibling, splitKey);
+        leafNode.setNextNodePtr(splitPid);
+        size = leafNode.getKeyCount();
+        splitSize = sibling.getKeyCount();
+        if((rc = sibling.write(splitPid, pf)) < 0) return rc;
+        return leafNode.write(pid, pf);
     }
-    // read the page into a non-leaf node
-    BTNonLeafNode nonleafNode;
 
-    if((rc = nonleafNode.read(currPid, pf)) < 0) return rc;
-    // locate child pointer
+    // find the child to go down to
+    BTNonLeafNode nonleafNode;
+    if((rc = nonleafNode.readCopy(pid, pf)) < 0) return rc;
+    PageId childPid;
     int eid;
-    rc = nonleafNode.locateChildPtr(searchKey, pid, eid);
-    //printf("BTreeIndex::recursivelyInsert: pid=%d\teid=%d\tsearchKey = %d\tlevel = %d\n",pid,eid,searchKey, level - 1);
-    // recursively go down a level
-    rc = recursivelyInsert(searchKey, rid, pid, level - 1);
-    // check if the next level is full
-    if(rc == RC_NODE_FULL) {
-        // need insert into this node
-        if(nonleafNode.getKeyCount() == BTNonLeafNode::MAX_KEY_NUM) {
-            PageId tempPid;
-            //we don't need the return value of tempPid
-            nonleafNode.locateChildPtr(searchKey,tempPid,eid);
-            //printf("BTreeIndex::recursivelyInsert: Merge: searchKey=%d\tcurrPid=%d\teid=%d\n",searchKey,currPid,eid);
-            // need to split
-            insertAndSplit(nonleafNode, currPid, eid, searchKey, pid);
-            pid = currPid;
-            // if this level is full, return rc
-            return RC_NODE_FULL;
-        } else {
-            //printf("BTreeIndex::recursivelyInsert: pid=%d\tsearchKey = %d\tlevel = %d\n",pid,searchKey, level);
-            // insert
-            nonleafNode.insert(searchKey, pid);
-            // write changes to file
-            nonleafNode.write(currPid, pf);
-            //cout<<"BTreeIndex::recursivelyInsert:exit"<<endl;
-            return 0;
+    nonleafNode.locateChildPtr(key, childPid, eid);
+
+    int childSize, childKey, childSplitSize;
+    PageId childSplitPid;
+    if((rc = insertInto(childPid, level - 1, key, rid, childSize, childKey,
+                        childSplitPid, childSplitSize)) < 0) return rc;
+
+    // the child has one more entry under it, or lost some to its sibling
+    nonleafNode.setSubtreeSize(eid, childSize);
+    if(childSplitPid < 0 ||
+       nonleafNode.insertAtEid(childKey, childSplitPid, childSplitSize, eid) == 0) {
+        // the child was not split, or the new sibling fits right after it
+        size = nonleafNode.getEntryCount();
+        return nonleafNode.write(pid, pf);
+    }
+
+    // this node is full as well. split it and push the middle key up
+    BTNonLeafNode sibling(pf.getPageSize());
+    splitPid = pf.endPid();
+    nonleafNode.insertAndSplit(childKey, childSplitPid, childSplitSize, eid, sibling, splitKey);
+    size = nonleafNode.getEntryCount();
+    splitSize = sibling.getEntryCount();
+    if((rc = sibling.write(splitPid, pf)) < 0) return rc;
+    return nonleafNode.write(pid, pf);
+}
+
+/*
+ * Insert all (key, RecordId) pairs of a sorter to the index.
+ * An empty index is built bottom-up, a non-empty one by inserting
+ * the pairs one by one in key order.
+ * @param entries[IN] the pairs to insert. sort() must have been called
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::bulkLoad(IndexSorter& entries)
+{
+    RC rc;
+    int key;
+    RecordId rid;
+
+    if(treeHeight != 0) {
+        while((rc = entries.next(key, rid)) == 0) {
+            if((rc = insert(key, rid)) < 0) return rc;
+        }
+        return (rc == RC_END_OF_INPUT) ? 0 : rc;
+    }
+
+    // fill the leaves left to right, each on the page after the previous one
+    BTLeafNode leaf(pf.getPageSize());
+    int perLeaf = leaf.getMaxKeyCount() * fillPercent / 100;
+    if(perLeaf < 1) perLeaf = 1;
+
+    // the first key, the pid and the size of every leaf, for the level above
+    vector<int> keys;
+    vector<PageId> pids;
+    vector<int> sizes;
+    PageId pid = pf.endPid();
+
+    while((rc = entries.next(key, rid)) == 0) {
+        int count = leaf.getKeyCount();
+        if(count == perLeaf) {
+            // the leaf is full. chain it to the next one and write it
+            leaf.setNextNodePtr(pid + 1);
+            sizes.push_back(count);
+            if((rc = leaf.write(pid, pf)) < 0) return rc;
+            pid++;
+            count = 0;
+            leaf.setKeyCount(count);
+        }
+        if(count == 0) {
+            keys.push_back(key);
+            pids.push_back(pid);
+        }
+        leaf.insertAtEid(key, rid, count);
+    }
+    if(rc != RC_END_OF_INPUT) return rc;
+
+    // nothing to load
+    if(pids.empty()) return 0;
+
+    // the last leaf ends the chain
+    leaf.setNextNodePtr(0);
+    sizes.push_back(leaf.getKeyCount());
+    if((rc = leaf.write(pid, pf)) < 0) return rc;
+
+    treeHeight = 1;
+    while(pids.size() > 1) {
+        if((rc = buildNonLeafLevel(keys, pids, sizes)) < 0) return rc;
+    }
+    rootPid = pids[0];
+    rootDirty = true;
+    return 0;
+}
+
+/*
+ * Build one non-leaf level above the given nodes, which become
+ * the children of the new level. The children are spread evenly
+ * over as few nodes as the fill factor allows.
+ * @param keys[IN/OUT] the first key under each node of the level below.
+ *                     replaced with the first keys of the new level
+ * @param pids[IN/OUT] the PageId of each node of the level below.
+ *                     replaced with the PageIds of the new level
+ * @param sizes[IN/OUT] the number of leaf entries under each node of the
+ *                      level below. replaced with those of the new level
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::buildNonLeafLevel(vector<int>& keys, vector<PageId>& pids, vector<int>& sizes)
+{
+    RC rc;
+    BTNonLeafNode node(pf.getPageSize());
+
+    // a node with n keys has n + 1 children. keep at least 3 children
+    // per node so that the even spread never leaves a node with one child
+    int perNode = node.getMaxKeyCount() * fillPercent / 100;
+    if(perNode < 2) perNode = 2;
+
+    int children = pids.size();
+    int nodes = (children + perNode) / (perNode + 1);
+    vector<int> upKeys;
+    vector<PageId> upPids;
+    vector<int> upSizes;
+    PageId pid = pf.endPid();
+
+    int first = 0;
+    for(int n = 0; n < nodes; n++) {
+        // the first (children % nodes) nodes take one extra child
+        int last = first + children / nodes + (n < children % nodes ? 1 : 0);
+
+        node.initializeRoot(pids[first], sizes[first], keys[first + 1],
+                            pids[first + 1], sizes[first + 1]);
+        for(int i = first + 2; i < last; i++) {
+            node.insertAtEid(keys[i], pids[i], sizes[i], i - first - 1);
         }
-    } else
-        return rc;
+        if((rc = node.write(pid, pf)) < 0) return rc;
+
+        upKeys.push_back(keys[first]);
+        upPids.push_back(pid++);
+        upSizes.push_back(node.getEntryCount());
+        first = last;
+    }
+
+    keys.swap(upKeys);
+    pids.swap(upPids);
+    sizes.swap(upSizes);
+    treeHeight++;
+    return 0;
 }
 
 /*
@@ -300,34 +386,143 @@ RC BTreeIndex::recursivelyInsert(int& searchKey, const RecordId& rid, PageId& pi
 RC BTreeIndex::locate(int searchKey, IndexCursor& cursor)
 {
     RC rc;
-    // read root pid
-    readRootAndHeight();
-    // initially cursor.pid = rootPid
-    cursor.pid = rootPid;
-//    printf("BTreeIndex::locate: rootPid=%d\n",rootPid);
-    // read the root node into buffer
-    char page[PageFile::PAGE_SIZE];
-
-    int currLevel = 1;
-    for(; currLevel <= treeHeight; currLevel++) {
-        // now cursor.pid is the pid of a node at nth level
-        if(currLevel == treeHeight) { // if we want to locate the key at leaf nodes
-            // read the page into a leaf node
-            BTLeafNode leafNode;
-            if((rc = leafNode.read(cursor.pid, pf)) < 0) return rc;
-            // locate searchKey
-            return leafNode.locate(searchKey, cursor.eid);
-        } 
-        // read the page into a non-leaf node
+    int eid;
+    BTLeafNode leafNode;
+
+    // find the leaf searchKey belongs to
+    if((rc = findLeaf(searchKey, cursor.pid, NULL, eid)) < 0) return rc;
+    if((rc = leafNode.read(cursor.pid, pf)) < 0) return rc;
+    __sync_fetch_and_add(&nodeReadCount, 1);
+    if(leafNode.locate(searchKey, cursor.eid) == 0) return 0;
+
+    // every key in the leaf is smaller. the entry is the first one
+    // of the next leaf, if there is one
+    cursor.pid = leafNode.getNextNodePtr();
+    cursor.eid = 0;
+    return (cursor.pid > 0) ? 0 : RC_NO_SUCH_RECORD;
+}
+
+/*
+ * Go down from the root to the leaf node that searchKey belongs to.
+ * @param searchKey[IN] the key to find
+ * @param pid[OUT] the PageId of the leaf
+ * @param parent[OUT] if not NULL, the parent of the leaf, pinned in the
+ * buffer pool. not set if the root is a leaf
+ * @param childEid[OUT] the child number of the leaf in its parent.
+ * -1 if the root is a leaf
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::findLeaf(int searchKey, PageId& pid, BTNonLeafNode* parent, int& childEid)
+{
+    RC rc;
+    BTNonLeafNode nonleafNode;
+    BTNonLeafNode* node = (parent != NULL) ? parent : &nonleafNode;
+
+    // rootPid and treeHeight were read at open() and are kept up to date
+    // by the inserts, so page 0 is not read again
+    if(treeHeight == 0) return RC_NO_SUCH_RECORD;
+    // initially pid = rootPid
+    pid = rootPid;
+    childEid = -1;
+
+    // go down the non-leaf levels. the nodes are pinned in the buffer
+    // pool, not copied
+    for(int level = treeHeight; level > 1; level--) {
+        if((rc = node->read(pid, pf)) < 0) return rc;
+        __sync_fetch_and_add(&nodeReadCount, 1);
+        node->locateChildPtr(searchKey, pid, childEid);
+    }
+    return 0;
+}
+
+/*
+ * Count the entries with lo <= key <= hi.
+ * The non-leaf nodes know the number of entries under each child, so
+ * only the nodes on the paths to lo and hi are read.
+ * @param lo[IN] the smallest key of the range
+ * @param hi[IN] the largest key of the range
+ * @param count[OUT] the number of entries in the range
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::countRange(int lo, int hi, int& count)
+{
+    RC rc;
+    int below, above;
+
+    count = 0;
+    if(lo > hi || treeHeight == 0) return 0;
+
+    // the entries < hi + 1 minus the entries < lo
+    if((rc = countBelow(lo, below)) < 0) return rc;
+    if(hi == INT_MAX) {
+        // every entry is < hi + 1, so take the total from the root
+        if(treeHeight == 1) {
+            BTLeafNode root;
+            if((rc = root.read(rootPid, pf)) < 0) return rc;
+            above = root.getKeyCount();
+        } else {
+            BTNonLeafNode root;
+            if((rc = root.read(rootPid, pf)) < 0) return rc;
+            above = root.getEntryCount();
+        }
+        __sync_fetch_and_add(&nodeReadCount, 1);
+    } else {
+        if((rc = countBelow(hi + 1, above)) < 0) return rc;
+    }
+    count = above - below;
+    return 0;
+}
+
+/*
+ * Count the entries whose key is smaller than searchKey.
+ * @param searchKey[IN] the key to count up to
+ * @param count[OUT] the number of entries with key < searchKey
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::countBelow(int searchKey, int& count)
+{
+    RC rc;
+    int below, eid;
+    PageId pid = rootPid;
+
+    count = 0;
+    // add up the children left of the path to searchKey
+    for(int level = treeHeight; level > 1; level--) {
         BTNonLeafNode nonleafNode;
-        if((rc = nonleafNode.read(cursor.pid, pf)) < 0) return rc;
-        // locate child pointer
-        rc = nonleafNode.locateChildPtr(searchKey, cursor.pid, cursor.eid);
-//        printf("BTreeIndex::locate: cursor.pid=%d\tcursor.eid=%d\n",cursor.pid,cursor.eid);
+        if((rc = nonleafNode.read(pid, pf)) < 0) return rc;
+        __sync_fetch_and_add(&nodeReadCount, 1);
+        nonleafNode.countBelow(searchKey, pid, below);
+        count += below;
     }
+
+    // and the keys of the leaf before searchKey
+    BTLeafNode leafNode;
+    if((rc = leafNode.read(pid, pf)) < 0) return rc;
+    __sync_fetch_and_add(&nodeReadCount, 1);
+    leafNode.locate(searchKey, eid);
+    count += eid;
     return 0;
 }
 
+/*
+ * Estimate the number of nodes a scan of a key range reads.
+ * @param rows[IN] the estimated number of entries in the range
+ * @return the estimated number of nodes
+ */
+double BTreeIndex::estimateNodes(double rows) const
+{
+    if(treeHeight == 0) return 0;
+
+    // leaves are assumed to be filled as bulkLoad() fills them
+    BTLeafNode leaf(pf.getPageSize());
+    double perLeaf = leaf.getMaxKeyCount() * fillPercent / 100.0;
+    if(perLeaf < 1) perLeaf = 1;
+
+    double leaves = rows / perLeaf;
+    if(leaves < 1) leaves = 1;
+    return (treeHeight - 1) + leaves;
+}
+
 /*
  * Read the (key, rid) pair at the location specified by the index cursor,
  * and move foward the cursor to the next entry.
@@ -338,25 +533,188 @@ RC BTreeIndex::locate(int searchKey, IndexCursor& cursor)
  */
 RC BTreeIndex::readForward(IndexCursor& cursor, int& key, RecordId& rid)
 {
-    //cout<<"BTreeIndex::readForward: cursor.eid = "<<cursor.eid<<endl;
     RC rc;
+    // the last leaf points to page 0, which is never a leaf
+    if (cursor.pid <= 0) return RC_END_OF_TREE;
+
     // read the page as a leaf node
     BTLeafNode currNode;
     if((rc = currNode.read(cursor.pid, pf)) < 0) return rc;
-    
-    if (cursor.pid == 0) {
-        return RC_END_OF_TREE;
-    }
+    __sync_fetch_and_add(&nodeReadCount, 1);
+
     // read the entry with eid
     if((rc = currNode.readEntry(cursor.eid, key, rid)) < 0) return rc;
-    
+
     if (cursor.eid < currNode.getKeyCount()-1) {
         cursor.eid++;
     } else {
         cursor.eid = 0;
-        //cout<<"BTreeIndex::readForward: nextnodeptr = "<<currNode.getNextNodePtr()<<endl;
         cursor.pid = currNode.getNextNodePtr();
     }
 
     return 0;
 }
+
+int IndexScan::readAhead = IndexScan::DEFAULT_READ_AHEAD;
+
+/*
+ * Set how many leaves a scan reads ahead.
+ * @param leaves[IN] the number of leaves, 0 to MAX_READ_AHEAD.
+ * 0 turns read-ahead off
+ * @return error code. 0 if no error
+ */
+RC IndexScan::setReadAhead(int leaves)
+{
+    if(leaves < 0 || leaves > MAX_READ_AHEAD) return RC_INVALID_ATTRIBUTE;
+    readAhead = leaves;
+    return 0;
+}
+
+IndexScan::IndexScan()
+{
+    index = NULL;
+    cursor.pid = 0;
+    cursor.eid = 0;
+    childEid = -1;
+    prefetchEid = 0;
+    endKey = INT_MAX;
+    lost = false;
+    lostKey = 0;
+}
+
+/*
+ * Start the scan at the first entry whose key is larger than or equal
+ * to searchKey. Only the leaves that may hold keys up to endKey are
+ * read ahead.
+ * @param index[IN] the open index to scan
+ * @param searchKey[IN] the smallest key to return
+ * @param endKey[IN] the largest key the caller will use
+ * @return error code. 0 if no error
+ */
+RC IndexScan::open(BTreeIndex& index, int searchKey, int endKey)
+{
+    RC rc;
+
+    this->index = &index;
+    this->endKey = endKey;
+    cursor.pid = 0;
+    cursor.eid = 0;
+    childEid = -1;
+
+    // an empty index has nothing to scan
+    if(index.treeHeight == 0) return 0;
+
+    // keep the parent of the leaf. its child pointers are the leaves to
+    // read ahead
+    if((rc = index.findLeaf(searchKey, cursor.pid, &parent, childEid)) < 0) return rc;
+    prefetchEid = childEid + 1;
+
+    // a lookup of a single key is usually done within this leaf. the
+    // next leaf is read ahead only if the scan moves to it
+    if(searchKey < endKey) readAheadLeaves();
+
+    if((rc = leaf.read(cursor.pid, index.pf)) < 0) return rc;
+    __sync_fetch_and_add(&BTreeIndex::nodeReadCount, 1);
+    leaf.locate(searchKey, cursor.eid);
+    return 0;
+}
+
+/*
+ * Copy the next entries of the scan, up to the end of the current leaf.
+ * The next leaf is read only after the current one is used up.
+ * @param keys[OUT] the keys of the entries
+ * @param rids[OUT] the RecordIds of the entries
+ * @param max[IN] the capacity of keys and rids
+ * @param count[OUT] the number of entries copied
+ * @return error code. RC_END_OF_TREE after the last entry
+ */
+RC IndexScan::nextBatch(int* keys, RecordId* rids, int max, int& count)
+{
+    RC rc;
+
+    count = 0;
+    if(cursor.pid <= 0) return RC_END_OF_TREE;
+
+    // move to the next leaf when the current one is used up.
+    // reading it releases the pin on the current one
+    while(cursor.eid >= leaf.getKeyCount()) {
+        cursor.pid = leaf.getNextNodePtr();
+        cursor.eid = 0;
+        if(cursor.pid <= 0) return RC_END_OF_TREE;
+        if((rc = leaf.read(cursor.pid, index->pf)) < 0) return rc;
+        __sync_fetch_and_add(&BTreeIndex::nodeReadCount, 1);
+        nextParentChild();
+        readAheadLeaves();
+    }
+
+    count = leaf.readEntries(cursor.eid, max, keys, rids);
+    cursor.eid += count;
+    return 0;
+}
+
+/*
+ * Find the current leaf in the parent after the scan moved to it.
+ * The leaves are linked in key order, so the leaf is usually the next
+ * child of the parent. After the last child, the next parent is found
+ * from the root.
+ */
+void IndexScan::nextParentChild()
+{
+    int key, eid;
+    PageId pid;
+    RecordId rid;
+
+    if(readAhead == 0 || index->treeHeight < 2) return;
+
+    if(childEid >= 0 && childEid < parent.getKeyCount() &&
+       parent.getChildPtr(childEid + 1) == cursor.pid) {
+        childEid++;
+        return;
+    }
+
+    // the first key of the leaf leads to its parent. with duplicate keys,
+    // it may lead to the parent of an earlier leaf holding the same key,
+    // so the next larger key is tried as well. if a key spans even more
+    // leaves, the leaves starting with it are not read ahead
+    childEid = -1;
+    if(leaf.readEntry(0, key, rid) < 0 || (lost && key == lostKey)) return;
+    for(int i = 0; i < 2 && (i == 0 || key < INT_MAX); i++) {
+        if(index->findLeaf(key + i, pid, &parent, eid) < 0) return;
+        for(eid = 0; eid <= parent.getKeyCount(); eid++) {
+            if(parent.getChildPtr(eid) == cursor.pid) {
+                childEid = eid;
+                prefetchEid = eid + 1;
+                lost = false;
+                return;
+            }
+        }
+    }
+    lost = true;
+    lostKey = key;
+}
+
+/*
+ * Read ahead the leaves that follow the current one under the parent,
+ * up to readAhead leaves past the current one and up to the last leaf
+ * that may hold endKey. Each leaf is asked for once, and all of them
+ * are asked for together.
+ */
+void IndexScan::readAheadLeaves()
+{
+    if(readAhead == 0 || childEid < 0) return;
+
+    int last = childEid + readAhead;
+    if(last > parent.getKeyCount()) last = parent.getKeyCount();
+    if(prefetchEid <= childEid) prefetchEid = childEid + 1;
+
+    PageId pids[MAX_READ_AHEAD];
+    int count = 0;
+    int key;
+    for(; prefetchEid <= last; prefetchEid++) {
+        // the key before a child is the smallest key under it
+        if(parent.readEntry(prefetchEid - 1, key, pids[count]) < 0 ||
+           key > endKey) break;
+        count++;
+    }
+    if(count > 0) index->pf.prefetch(pids, count);
+}
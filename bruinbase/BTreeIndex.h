@@ -14,7 +14,10 @@
 #include "PageFile.h"
 #include "RecordFile.h"
 #include "BTreeNode.h"
+#include "IndexSorter.h"
+#include <climits>
 #include <string>
+#include <vector>
              
 /**
  * The data structure to point to a particular entry at a b+tree leaf node.
@@ -35,11 +38,28 @@ typedef struct {
  */
 class BTreeIndex {
  public:
+  static const int DEFAULT_FILL_PERCENT = 90;  // node fill of bulkLoad()
+
+  // the layout of the nodes, stored in page 0 next to rootPid and
+  // treeHeight. indexes written in an older layout (0: before keys were
+  // stored contiguously, 2: before non-leaf nodes counted the entries
+  // under their children) are rejected by open()
+  static const int NODE_FORMAT = 3;
+
   BTreeIndex();
 
+  /**
+   * Set how full bulkLoad() packs the nodes. The free space is left
+   * for later inserts, so that they do not split the nodes at once.
+   * @param percent[IN] the fill factor of the nodes, 10 to 100
+   * @return error code. 0 if no error
+   */
+  static RC setFillPercent(int percent);
+
   /**
    * Open the index file in read or write mode.
    * Under 'w' mode, the index file should be created if it does not exist.
+   * RC_INVALID_FILE_FORMAT is returned for an index in an older node layout.
    * @param indexname[IN] the name of the index file
    * @param mode[IN] 'r' for read, 'w' for write
    * @return error code. 0 if no error
@@ -47,7 +67,8 @@ class BTreeIndex {
   RC open(const std::string& indexname, char mode);
 
   /**
-   * Close the index file.
+   * Close the index file. The root and the height of the tree are
+   * kept in memory while the index is open and written here if changed.
    * @return error code. 0 if no error
    */
   RC close();
@@ -60,12 +81,17 @@ class BTreeIndex {
    */
   RC insert(int key, const RecordId& rid);
 
-  RC insertAndSplit(BTLeafNode& currNode, PageId& currPid, int eid, int& key, const RecordId& rid);
-  RC insertAndSplit(BTNonLeafNode& currNode, PageId& currPid, int eid, int& key, const PageId& pid);
-
-  RC initializeRoot(const PageId& currPid, int key, const PageId& siblingPid);
+  /**
+   * Insert all (key, RecordId) pairs of a sorter to the index.
+   * If the index is empty, the tree is built bottom-up: the leaves are
+   * filled left to right in key order and written to consecutive pages,
+   * followed by each level of non-leaf nodes above them.
+   * Otherwise the pairs are inserted one by one in key order.
+   * @param entries[IN] the pairs to insert. sort() must have been called
+   * @return error code. 0 if no error
+   */
+  RC bulkLoad(IndexSorter& entries);
 
-  RC recursivelyInsert(int& searchKey, const RecordId& rid, PageId& pid, int level);
   /**
    * Find the leaf-node index entry whose key value is larger than or
    * equal to searchKey and output its location (i.e., the page id of the node
@@ -98,6 +124,36 @@ class BTreeIndex {
    */
   RC readForward(IndexCursor& cursor, int& key, RecordId& rid);
 
+  /**
+   * @return the number of index nodes read by lookups and scans so far
+   */
+  static int getNodeReadCount() { return nodeReadCount; }
+
+  /**
+   * Count the entries with lo <= key <= hi.
+   * Every non-leaf node keeps the number of leaf entries under each of
+   * its children, so only the nodes on the paths to lo and hi are read.
+   * @param lo[IN] the smallest key of the range
+   * @param hi[IN] the largest key of the range
+   * @param count[OUT] the number of entries in the range
+   * @return error code. 0 if no error
+   */
+  RC countRange(int lo, int hi, int& count);
+
+  /**
+   * @return the height of the tree. 0 if the index is empty
+   */
+  int getTreeHeight() const { return treeHeight; }
+
+  /**
+   * Estimate the number of nodes a scan of a key range reads: the
+   * non-leaf nodes on the way down and the leaves holding the range.
+   * @param rows[IN] the estimated number of entries in the range, e.g.
+   * from the statistics of the table
+   * @return the estimated number of nodes
+   */
+  double estimateNodes(double rows) const;
+
   /** 
    * Write rootPid and treeHeight to file.
    * @return error code, 0 if no error
@@ -111,14 +167,136 @@ class BTreeIndex {
   RC readRootAndHeight();
 
  private:
+  friend class IndexScan;
+
+  /**
+   * Go down from the root to the leaf node that searchKey belongs to.
+   * @param searchKey[IN] the key to find
+   * @param pid[OUT] the PageId of the leaf
+   * @param parent[OUT] if not NULL, the parent of the leaf, pinned in the
+   * buffer pool. not set if the root is a leaf
+   * @param childEid[OUT] the child number of the leaf in its parent.
+   * -1 if the root is a leaf
+   * @return error code. 0 if no error
+   */
+  RC findLeaf(int searchKey, PageId& pid, BTNonLeafNode* parent, int& childEid);
+
+  /**
+   * Insert (key, RecordId) pair into the subtree rooted at pid.
+   * If the node at pid overflows, it is split and the new sibling
+   * must be inserted into the parent as (splitKey, splitPid).
+   * @param pid[IN] the root of the subtree
+   * @param level[IN] the height of the subtree. 1 for a leaf node
+   * @param key[IN] the key to insert
+   * @param rid[IN] the RecordId to insert
+   * @param size[OUT] the number of leaf entries under pid after the insert
+   * @param splitKey[OUT] the first key of the new sibling
+   * @param splitPid[OUT] the PageId of the new sibling. -1 if no split
+   * @param splitSize[OUT] the number of leaf entries under the new sibling
+   * @return error code. 0 if no error
+   */
+  RC insertInto(PageId pid, int level, int key, const RecordId& rid,
+                int& size, int& splitKey, PageId& splitPid, int& splitSize);
+
+  /**
+   * Count the entries whose key is smaller than searchKey.
+   * @param searchKey[IN] the key to count up to
+   * @param count[OUT] the number of entries with key < searchKey
+   * @return error code. 0 if no error
+   */
+  RC countBelow(int searchKey, int& count);
+
+  /**
+   * Build one non-leaf level of a bulk-loaded tree above the given nodes.
+   * On return, keys and pids describe the nodes of the new level.
+   * @param keys[IN/OUT] the first key under each node of the level below
+   * @param pids[IN/OUT] the PageId of each node of the level below
+   * @param sizes[IN/OUT] the number of leaf entries under each node
+   * @return error code. 0 if no error
+   */
+  RC buildNonLeafLevel(std::vector<int>& keys, std::vector<PageId>& pids,
+                       std::vector<int>& sizes);
+
+  static int fillPercent;    /// the node fill factor of bulkLoad()
+  static int nodeReadCount;  /// # of nodes read by lookups and scans
+
   PageFile pf;         /// the PageFile used to store the actual b+tree in disk
 
   PageId   rootPid;    /// the PageId of the root node
   int      treeHeight; /// the height of the tree
-  /// Note that the content of the above two variables will be gone when
-  /// this class is destructed. Make sure to store the values of the two 
-  /// variables in disk, so that they can be reconstructed when the index
-  /// is opened again later.
+  bool     rootDirty;  /// rootPid or treeHeight changed since written
+  /// The variables are read from page 0 at open() and used by every
+  /// lookup from memory. Changes are written back to page 0 at close().
+};
+
+/**
+ * A forward scan over the leaf entries of a BTreeIndex.
+ * Unlike readForward(), which reads the leaf again for every entry,
+ * the scan keeps the current leaf pinned in the buffer pool and returns
+ * its entries in batches, so each leaf is read once.
+ * While the entries of a leaf are consumed, the next leaves are read
+ * ahead in the background. Their pids are taken from the parent of the
+ * leaf, which the scan keeps pinned as well.
+ * The scan must be finished or destroyed before the index is closed.
+ */
+class IndexScan {
+ public:
+  static const int BATCH_SIZE = 128;         // a good batch size for nextBatch()
+  static const int DEFAULT_READ_AHEAD = 8;   // leaves read ahead by default
+  static const int MAX_READ_AHEAD = 256;
+
+  IndexScan();
+
+  /**
+   * Start the scan at the first entry whose key is larger than or equal
+   * to searchKey. Only the leaves that may hold keys up to endKey are
+   * read ahead.
+   * @param index[IN] the open index to scan
+   * @param searchKey[IN] the smallest key to return
+   * @param endKey[IN] the largest key the caller will use
+   * @return error code. 0 if no error
+   */
+  RC open(BTreeIndex& index, int searchKey, int endKey = INT_MAX);
+
+  /**
+   * Copy the next entries of the scan, up to the end of the current leaf.
+   * The next leaf is read only after the current one is used up.
+   * @param keys[OUT] the keys of the entries
+   * @param rids[OUT] the RecordIds of the entries
+   * @param max[IN] the capacity of keys and rids
+   * @param count[OUT] the number of entries copied
+   * @return error code. RC_END_OF_TREE after the last entry
+   */
+  RC nextBatch(int* keys, RecordId* rids, int max, int& count);
+
+  /**
+   * Set how many leaves ahead of the current one the scans read.
+   * @param leaves[IN] 0 to MAX_READ_AHEAD. 0 turns read-ahead off
+   * @return error code. 0 if no error
+   */
+  static RC setReadAhead(int leaves);
+
+ private:
+  IndexScan(const IndexScan&);
+  IndexScan& operator=(const IndexScan&);
+
+  // find the current leaf in its parent after moving to it
+  void nextParentChild();
+
+  // read ahead the leaves up to readAhead past the current one
+  void readAheadLeaves();
+
+  BTreeIndex* index;     /// the scanned index
+  BTLeafNode leaf;       /// the current leaf, pinned
+  IndexCursor cursor;    /// the next entry to return
+  BTNonLeafNode parent;  /// the parent of the current leaf, pinned
+  int childEid;          /// the child number of the leaf in parent. -1 if unknown
+  int prefetchEid;       /// the next child of parent to read ahead
+  int endKey;            /// no leaf starting after endKey is read ahead
+  bool lost;             /// the parent of the leaves starting with
+  int lostKey;           ///   lostKey was not found
+
+  static int readAhead;  /// # of leaves to read ahead
 };
 
 #endif /* BTREEINDEX_H */
@@ -1,11 +1,40 @@
+#include <cstring>
+#include <vector>
 #include "BTreeNode.h"
 #include "PageFile.h"
+#include "KeySearch.h"
 
 using namespace std;
+
+// size of an entry in a leaf node: a key and its RecordId
+static const int LEAF_ENTRY_SIZE = sizeof(int) + sizeof(RecordId);
+// size of an entry in a non-leaf node: a key, the child after it and
+// the number of leaf entries under that child
+static const int NONLEAF_ENTRY_SIZE = sizeof(int) + sizeof(PageId) + sizeof(int);
+
 BTLeafNode::BTLeafNode()
 {
-    memset(buffer, 0, PageFile::PAGE_SIZE);
+    buffer = local = NULL;
+    pageSize = 0;
+}
+
+BTLeafNode::BTLeafNode(int pageSize)
+{
+    this->pageSize = pageSize;
+    buffer = local = new char[pageSize];
+    memset(local, 0, pageSize);
+}
+
+BTLeafNode::~BTLeafNode()
+{
+    delete [] local;
+}
+
+int BTLeafNode::getMaxKeyCount() const
+{
+    return (pageSize - (sizeof(int) + sizeof(PageId))) / LEAF_ENTRY_SIZE;
 }
+
 /*
  * Read the content of the node from the page pid in the PageFile pf.
  * @param pid[IN] the PageId to read
@@ -13,13 +42,38 @@ BTLeafNode::BTLeafNode()
  * @return 0 if successful. Return an error code if there is an error.
  */
 RC BTLeafNode::read(PageId pid, const PageFile& pf)
-{ 
+{
 	RC rc;
-	//read the page with PageId pid from PageFile pf
-	if ((rc = pf.read(pid,buffer)) < 0)	return rc;
-	return 0; 
+	// pin the page with PageId pid from PageFile pf and work on the frame
+	if ((rc = pf.fetch(pid, page)) < 0) {
+		buffer = local;
+		return rc;
+	}
+	buffer = page.data();
+	pageSize = pf.getPageSize();
+	return 0;
 }
-    
+
+/*
+ * Read the content of the node from the page pid into a copy owned by
+ * the node, to be changed and written back with write().
+ * @param pid[IN] the PageId to read
+ * @param pf[IN] PageFile to read from
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTLeafNode::readCopy(PageId pid, const PageFile& pf)
+{
+	// a change that fails half way must not be left in the shared frame
+	page.release();
+	if (local == NULL || pageSize != pf.getPageSize()) {
+		delete [] local;
+		pageSize = pf.getPageSize();
+		local = new char[pageSize];
+	}
+	buffer = local;
+	return pf.read(pid, local);
+}
+
 /*
  * Write the content of the node to the page pid in the PageFile pf.
  * @param pid[IN] the PageId to write to
@@ -27,11 +81,11 @@ RC BTLeafNode::read(PageId pid, const PageFile& pf)
  * @return 0 if successful. Return an error code if there is an error.
  */
 RC BTLeafNode::write(PageId pid, PageFile& pf)
-{ 
+{
 	RC rc;
 	// write the content in buffer into the page with PageId pid
 	if((rc = pf.write(pid, buffer)) < 0) return rc;
-	return 0; 
+	return 0;
 }
 
 /*
@@ -43,7 +97,7 @@ int BTLeafNode::getKeyCount()
 	// the first four bytes of a page contains # keys in the page
 	int count;
 	memcpy(&count, buffer, sizeof(int));
-	return count; 
+	return count;
 }
 
 /*
@@ -51,84 +105,55 @@ int BTLeafNode::getKeyCount()
  * @param count[IN] the key count to be written in buffer.
  * @return 0 if successful. Return an error code if there is an error.
  */
- RC BTLeafNode::setKeyCount(int count)
- {
- 	//the first four bytes of a page contains # keys in the node/page.
- 	memcpy(buffer, &count, sizeof(int));
- }
-
-/*
- * Return the pointer to the new entry in the buffer.
- * @param eid[IN] the key count to be written in buffer.
- * @return the pointer.
- */
-char* BTLeafNode::entryPtr(int eid)
+RC BTLeafNode::setKeyCount(int count)
 {
-	return buffer + eid * (sizeof(int) + sizeof(RecordId)) + sizeof(int);
+	// the first four bytes of a page contains # keys in the node/page.
+	memcpy(buffer, &count, sizeof(int));
+	return 0;
 }
 
 /*
- * Write an entry to a given position in the buffer.
- * @param ptr[IN] the pointer pointing to the position to insert a new entry.
- * @param key[IN] the key to be inserted to buffer.
- * @param rid[IN] the RecordId to be inserted to buffer.
- * @return 0 if successful, return an error code if error occurs.
+ * Insert a (key, rid) pair to the node.
+ * @param key[IN] the key to insert
+ * @param rid[IN] the RecordId to insert
+ * @return 0 if successful. Return an error code if the node is full.
  */
- RC BTLeafNode::writeToPtr(char* ptr, int key, const RecordId& rid)
- {
- 	//store the key
- 	memcpy(ptr, &rid, sizeof(RecordId));
- 	//store the RecordId
- 	memcpy(ptr + sizeof(RecordId), &key, sizeof(int));
- 	return 0;
- }
+RC BTLeafNode::insert(int key, const RecordId& rid)
+{
+	// check if the node has room for the key
+	if (getKeyCount() >= getMaxKeyCount()) return RC_NODE_FULL;
+
+	// find out where the key should be inserted and insert it there
+	int eid;
+	locate(key, eid);
+	return insertAtEid(key, rid, eid);
+}
 
 /*
- * Insert a (key, rid) pair to the node.
+ * Insert the (key, rid) pair as the eid-th entry.
  * @param key[IN] the key to insert
  * @param rid[IN] the RecordId to insert
+ * @param eid[IN] the position of the new entry
  * @return 0 if successful. Return an error code if the node is full.
  */
-RC BTLeafNode::insert(int key, const RecordId& rid)
-{ 
-	RC rc;
-	// get the number of keys in page
+RC BTLeafNode::insertAtEid(int key, const RecordId& rid, int eid)
+{
 	int count = getKeyCount();
-    // printf("BTLeafNode::insert keyCount = %d\n", count);
-	// check if it exceeds MAX_KEY_NUM
-	if(count == MAX_KEY_NUM) {
-		return RC_NODE_FULL;
-	} else if(count < MAX_KEY_NUM) {
-		int eid = 0;
-        // printf("BTLeafNode::insert key = %d\n", key);
-		// find out where the key should be inserted
-		locate(key, eid);
-        // insert at eid
-        insertAtEid(key, rid, eid);
-	}
-	return 0; 
-}
-
-RC BTLeafNode::insertAtEid(int key, const RecordId& rid, int eid) {
-	// get the location of eid th entry
-	char* ptr = entryPtr(eid);
-    // get the number of keys in page
-    int count = getKeyCount();
-	// how many keys are bigger than key
-	int remain = count - eid;
-	// copy the remaining entries into buf
-    size_t remainSize = (sizeof(int) + sizeof(RecordId)) * remain + sizeof(int);
-	char buf[remainSize];
-	memcpy(buf, ptr, remainSize);
-	// write the new entry into buffer
-	writeToPtr(ptr, key, rid);
-	// copy back from buf to buffer
-	memcpy(ptr + sizeof(int) + sizeof(RecordId), buf, remainSize);
+	if (count >= getMaxKeyCount()) return RC_NODE_FULL;
+
+	// shift the keys and the RecordIds from eid on
+	int* k = keys();
+	RecordId* r = rids();
+	memmove(k + eid + 1, k + eid, (count - eid) * sizeof(int));
+	memmove(r + eid + 1, r + eid, (count - eid) * sizeof(RecordId));
+	// write the new entry into the gap
+	k[eid] = key;
+	r[eid] = rid;
 	// increase the count of keys by 1
 	setKeyCount(count + 1);
-    // printf("BTLeafNode::insertAtEid count=%d\n",getKeyCount());
-
+	return 0;
 }
+
 /*
  * Insert the (key, rid) pair to the node
  * and split the node half and half with sibling.
@@ -139,36 +164,38 @@ RC BTLeafNode::insertAtEid(int key, const RecordId& rid, int eid) {
  * @param siblingKey[OUT] the first key in the sibling node after split.
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTLeafNode::insertAndSplit(int key, const RecordId& rid, int eid,
+RC BTLeafNode::insertAndSplit(int key, const RecordId& rid,
                               BTLeafNode& sibling, int& siblingKey)
-{ 
-	// get the eid of half of the entries
-	int halfCount = MAX_KEY_NUM / 2;
-	// get the location of the half point of the old node
-	char *halfPtr = entryPtr(halfCount);
-	// copy the second half to the new node
-	size_t secondSize = (MAX_KEY_NUM - halfCount) * (sizeof(int) + sizeof(RecordId));
-	memcpy(sibling.entryPtr(0), halfPtr, secondSize);
-	// copy next node pointer to half point of the old node
-	memcpy(halfPtr, entryPtr(MAX_KEY_NUM), sizeof(int));
-	// update # of keys of the old node
-	setKeyCount(halfCount);
-	// update # of keys of the new node
-	sibling.setKeyCount(MAX_KEY_NUM - halfCount);
-	// find the first key in the sibling node after split
-	RecordId firstRid;
-	sibling.readEntry(0, siblingKey, firstRid);
-	// check if the key is smaller than siblingKey
-	if(eid <= MAX_KEY_NUM / 2)
-		// insert into old node
+{
+	int count = getKeyCount();
+
+	// with the new key there are count + 1 entries.
+	// this node keeps the first half, the sibling gets the rest.
+	int eid;
+	locate(key, eid);
+	int leftCount = (count + 1) / 2;
+
+	// the old entries that move to the sibling start at moveFrom
+	int moveFrom = (eid < leftCount) ? leftCount - 1 : leftCount;
+	int moveCount = count - moveFrom;
+	memcpy(sibling.keys(), keys() + moveFrom, moveCount * sizeof(int));
+	memcpy(sibling.rids(), rids() + moveFrom, moveCount * sizeof(RecordId));
+	sibling.setKeyCount(moveCount);
+	setKeyCount(moveFrom);
+
+	// insert the new entry into the half it belongs to
+	if (eid < leftCount) {
 		insertAtEid(key, rid, eid);
-	else
-    {
-//        printf("BTLeafNode::insertAndSplit: eid=%d\tkey=%d\n",eid,key);
-		// insert the new key into the new node
-		sibling.insertAtEid(key, rid, eid - MAX_KEY_NUM / 2);
-    }
-	
+	} else {
+		sibling.insertAtEid(key, rid, eid - leftCount);
+	}
+
+	// the sibling follows this node in the leaf chain
+	sibling.setNextNodePtr(getNextNodePtr());
+	setNextNodePtr(0);
+
+	// the first key of the sibling goes up to the parent
+	siblingKey = sibling.keys()[0];
 	return 0;
 }
 
@@ -178,29 +205,13 @@ RC BTLeafNode::insertAndSplit(int key, const RecordId& rid, int eid,
  * Remeber that all keys inside a B+tree node should be kept sorted.
  * @param searchKey[IN] the key to search for
  * @param eid[OUT] the entry number that contains a key larger than or equalty to searchKey
- * @return 0 if successful. Return an error code if there is an error.
+ * @return 0 if successful. RC_NO_SUCH_RECORD if every key is smaller.
  */
 RC BTLeafNode::locate(int searchKey, int& eid)
-{ 
-	RC rc;
-	int tempKey;
-	RecordId rid;
-	eid = 0;
-	int keyCount = getKeyCount();
-    //printf("BTLeafNode::locate keyCount = %d\n", keyCount);
-    if (keyCount == 0)
-        return 0;
-	// get the first key
-	readEntry(eid, tempKey, rid);
-    //printf("BTLeafNode::locate tempKey = %d,\teid=%d\n", tempKey,eid);
-	while(tempKey < searchKey && eid < keyCount) {
-		readEntry(++eid, tempKey, rid);
-       //printf("BTLeafNode::locate tempKey = %d,\teid=%d\n", tempKey,eid);
-	}
-	if(eid == keyCount)
-		return RC_NO_SUCH_RECORD;
-	// if no key is larger than searchKey, return 
-	return 0;
+{
+	int count = getKeyCount();
+	eid = KeySearch::lowerBound(keys(), count, searchKey);
+	return (eid < count) ? 0 : RC_NO_SUCH_RECORD;
 }
 
 /*
@@ -212,51 +223,79 @@ RC BTLeafNode::locate(int searchKey, int& eid)
  */
 RC BTLeafNode::readEntry(int eid, int& key, RecordId& rid)
 {
-	// get to the location in buffer
-	char *ptr = entryPtr(eid);
-	// read key first, then rid
-	memcpy(&rid, ptr, sizeof(RecordId));
-	memcpy(&key, ptr + sizeof(RecordId), sizeof(int));
-    printf("BTLeafNode::readEntry: eid=%d\tkey=%d\n", eid, key);
-	return 0; 
+	if (eid < 0 || eid >= getKeyCount()) return RC_INVALID_CURSOR;
+
+	key = keys()[eid];
+	rid = rids()[eid];
+	return 0;
+}
+
+/*
+ * Copy up to max (key, rid) pairs starting from the eid entry.
+ * @param eid[IN] the first entry to copy
+ * @param max[IN] the maximum number of entries to copy
+ * @param keys[OUT] the keys of the entries
+ * @param rids[OUT] the RecordIds of the entries
+ * @return the number of entries copied
+ */
+int BTLeafNode::readEntries(int eid, int max, int* keys, RecordId* rids)
+{
+	int count = getKeyCount() - eid;
+	if (count > max) count = max;
+	if (count <= 0) return 0;
+
+	// the keys and the RecordIds are each stored contiguously
+	memcpy(keys, this->keys() + eid, count * sizeof(int));
+	memcpy(rids, this->rids() + eid, count * sizeof(RecordId));
+	return count;
 }
 
 /*
  * Return the pid of the next slibling node.
- * @return the PageId of the next sibling node 
+ * @return the PageId of the next sibling node. 0 if this is the last leaf.
  */
 PageId BTLeafNode::getNextNodePtr()
-{ 
-	// get the key count
-	int keyCount = getKeyCount();
-	// get the location at the end of last entry
-	char *ptr = entryPtr(keyCount);
-	// get the PageId of next node
+{
+	// the next node pointer follows the key count
 	PageId pid;
-	memcpy(&pid, ptr, sizeof(PageId));
-
-	return pid; 
+	memcpy(&pid, buffer + sizeof(int), sizeof(PageId));
+	return pid;
 }
 
 /*
  * Set the pid of the next slibling node.
- * @param pid[IN] the PageId of the next sibling node 
+ * @param pid[IN] the PageId of the next sibling node
  * @return 0 if successful. Return an error code if there is an error.
  */
 RC BTLeafNode::setNextNodePtr(PageId pid)
-{ 
-	// get the key count
-	int keyCount = getKeyCount();
-	// get the location at the end of last entry
-	char *ptr = entryPtr(keyCount);
-	// set the new PageId of next node
-	memcpy(ptr, &pid, sizeof(PageId));
-	return 0; 
+{
+	// the next node pointer follows the key count
+	memcpy(buffer + sizeof(int), &pid, sizeof(PageId));
+	return 0;
 }
 
 BTNonLeafNode::BTNonLeafNode()
 {
-    memset(buffer, 0, PageFile::PAGE_SIZE);
+    buffer = local = NULL;
+    pageSize = 0;
+}
+
+BTNonLeafNode::BTNonLeafNode(int pageSize)
+{
+    this->pageSize = pageSize;
+    buffer = local = new char[pageSize];
+    memset(local, 0, pageSize);
+}
+
+BTNonLeafNode::~BTNonLeafNode()
+{
+    delete [] local;
+}
+
+int BTNonLeafNode::getMaxKeyCount() const
+{
+    // the key count, and the first child with its size
+    return (pageSize - (sizeof(int) + sizeof(PageId) + sizeof(int))) / NONLEAF_ENTRY_SIZE;
 }
 
 /*
@@ -266,13 +305,38 @@ BTNonLeafNode::BTNonLeafNode()
  * @return 0 if successful. Return an error code if there is an error.
  */
 RC BTNonLeafNode::read(PageId pid, const PageFile& pf)
-{ 
+{
 	RC rc;
-	//read the page with PageId pid from PageFile pf
-	if ((rc = pf.read(pid,buffer)) < 0)	return rc;
-	return 0; 
+	// pin the page with PageId pid from PageFile pf and work on the frame
+	if ((rc = pf.fetch(pid, page)) < 0) {
+		buffer = local;
+		return rc;
+	}
+	buffer = page.data();
+	pageSize = pf.getPageSize();
+	return 0;
 }
-    
+
+/*
+ * Read the content of the node from the page pid into a copy owned by
+ * the node, to be changed and written back with write().
+ * @param pid[IN] the PageId to read
+ * @param pf[IN] PageFile to read from
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTNonLeafNode::readCopy(PageId pid, const PageFile& pf)
+{
+	// a change that fails half way must not be left in the shared frame
+	page.release();
+	if (local == NULL || pageSize != pf.getPageSize()) {
+		delete [] local;
+		pageSize = pf.getPageSize();
+		local = new char[pageSize];
+	}
+	buffer = local;
+	return pf.read(pid, local);
+}
+
 /*
  * Write the content of the node to the page pid in the PageFile pf.
  * @param pid[IN] the PageId to write to
@@ -280,11 +344,11 @@ RC BTNonLeafNode::read(PageId pid, const PageFile& pf)
  * @return 0 if successful. Return an error code if there is an error.
  */
 RC BTNonLeafNode::write(PageId pid, PageFile& pf)
-{ 
+{
 	RC rc;
 	//write the content in buffer into the page with PageId pid
 	if((rc = pf.write(pid, buffer)) < 0) return rc;
-	return 0; 
+	return 0;
 }
 
 /*
@@ -292,11 +356,11 @@ RC BTNonLeafNode::write(PageId pid, PageFile& pf)
  * @return the number of keys in the node
  */
 int BTNonLeafNode::getKeyCount()
-{ 
+{
 	// the first four bytes of a page contains # keys in the page
 	int count;
 	memcpy(&count, buffer, sizeof(int));
-	return count;  
+	return count;
 }
 
 /*
@@ -304,184 +368,227 @@ int BTNonLeafNode::getKeyCount()
  * @param count[IN] the key count to be written in buffer.
  * @return 0 if successful. Return an error code if there is an error.
  */
- RC BTNonLeafNode::setKeyCount(int count)
- {
- 	//the first four bytes of a page contains # keys in the node/page.
- 	memcpy(buffer, &count, sizeof(int));
- }
+RC BTNonLeafNode::setKeyCount(int count)
+{
+	//the first four bytes of a page contains # keys in the node/page.
+	memcpy(buffer, &count, sizeof(int));
+	return 0;
+}
 
 /*
  * Insert a (key, pid) pair to the node.
  * @param key[IN] the key to insert
  * @param pid[IN] the PageId to insert
+ * @param size[IN] the number of leaf entries under pid
  * @return 0 if successful. Return an error code if the node is full.
  */
-RC BTNonLeafNode::insert(int key, PageId pid)
-{ 
-	RC rc;
-	// get the number of keys in page
+RC BTNonLeafNode::insert(int key, PageId pid, int size)
+{
 	int count = getKeyCount();
-	// check if it exceeds MAX_KEY_NUM
-	if(count == MAX_KEY_NUM) {
-		return RC_NODE_FULL;
-	} else if(count < MAX_KEY_NUM) {
-		int eid = 0;
-		PageId tempPid;
-		// find out where the key should be inserted
-		locateChildPtr(key, tempPid, eid);
-		// insert at eid
-        insertAtEid(key, pid, eid);
-	}
-	return 0; 
+	if (count >= getMaxKeyCount()) return RC_NODE_FULL;
+
+	// the new entry goes after all keys <= key
+	int eid = KeySearch::lowerBound(keys(), count, key);
+	while (eid < count && keys()[eid] == key) eid++;
+	return insertAtEid(key, pid, size, eid);
+}
+
+/**
+* Read the (key, pid) pair from the eid entry.
+* @param eid[IN] the entry number to read the (key, pid) pair from
+* @param key[OUT] the key from the slot
+* @param pid[OUT] the PageId from the slot
+* @return 0 if successful. Return an error code if there is an error.
+*/
+RC BTNonLeafNode::readEntry(int eid, int& key, PageId& pid)
+{
+	if (eid < 0 || eid >= getKeyCount()) return RC_INVALID_CURSOR;
+
+	// the child after the eid-th key
+	key = keys()[eid];
+	pid = pids()[eid + 1];
+	return 0;
 }
 
 /*
- * Write an entry to a given position in the buffer.
- * @param ptr[IN] the pointer pointing to the position to insert a new entry.
- * @param key[IN] the key to be inserted to buffer.
- * @param pid[IN] the PageId to be inserted to buffer.
- * @return 0 if successful, return an error code if error occurs.
+ * Return the eid-th child pointer, the child before the eid-th key.
+ * @param eid[IN] the child number, 0 to getKeyCount()
+ * @return the PageId of the child. -1 if eid is out of range
  */
- RC BTNonLeafNode::writeToPtr(char* ptr, int key, const PageId& pid)
- {
- 	//store the key
- 	memcpy(ptr, &key, sizeof(int));
- 	//store the page id
- 	memcpy(ptr + sizeof(int), &pid, sizeof(PageId));
- 	return 0;
- }
+PageId BTNonLeafNode::getChildPtr(int eid)
+{
+	if (eid < 0 || eid > getKeyCount()) return -1;
+	return pids()[eid];
+}
 
 /*
- * Return the pointer to the new entry in the buffer.
- * @param eid[IN] the key count to be written in buffer.
- * @return the pointer.
+ * Return the number of leaf entries under the eid-th child.
+ * @param eid[IN] the child number, 0 to getKeyCount()
+ * @return the number of entries. -1 if eid is out of range
  */
-char* BTNonLeafNode::entryPtr(int eid)
+int BTNonLeafNode::getSubtreeSize(int eid)
 {
-	return buffer + eid * (sizeof(int) + sizeof(PageId)) + sizeof(int) + sizeof(PageId);
+	if (eid < 0 || eid > getKeyCount()) return -1;
+	return sizes()[eid];
 }
 
-/**
-* Read the (key, rid) pair from the eid entry.
-* @param eid[IN] the entry number to read the (key, rid) pair from
-* @param key[OUT] the key from the slot
-* @param pid[OUT] the PageId from the slot
-* @return 0 if successful. Return an error code if there is an error.
-*/
-RC BTNonLeafNode::readEntry(int eid, int& key, PageId& pid) 
+/*
+ * Set the number of leaf entries under the eid-th child.
+ * @param eid[IN] the child number, 0 to getKeyCount()
+ * @param size[IN] the number of entries
+ * @return 0 if successful. Return an error code if eid is out of range.
+ */
+RC BTNonLeafNode::setSubtreeSize(int eid, int size)
+{
+	if (eid < 0 || eid > getKeyCount()) return RC_INVALID_CURSOR;
+	sizes()[eid] = size;
+	return 0;
+}
+
+/*
+ * Return the number of leaf entries under the node.
+ * @return the sum of the sizes of all children
+ */
+int BTNonLeafNode::getEntryCount()
+{
+	int total = 0;
+	int* s = sizes();
+	for (int i = 0, n = getKeyCount(); i <= n; i++) total += s[i];
+	return total;
+}
+
+/*
+ * Count the leaf entries under the children before the one searchKey
+ * belongs to, and find that child as locateChildPtr() does.
+ * All keys under the children before it are smaller than searchKey.
+ * @param searchKey[IN] the key to count up to
+ * @param pid[OUT] the child searchKey belongs to
+ * @param below[OUT] the number of entries under the children before pid
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTNonLeafNode::countBelow(int searchKey, PageId& pid, int& below)
 {
-	if(eid > getKeyCount())
-		return RC_INVALID_CURSOR;
-	// get to the location in buffer
-	char *ptr = entryPtr(eid);
-  
-	// read pid first, then key
-	memcpy(&pid, ptr - sizeof(PageId), sizeof(PageId));
-	memcpy(&key, ptr, sizeof(int));
-    printf("BTNonLeafNode::readEntry: eid=%d\tpid=%d\tkey=%d\n", eid, pid, key);
-	return 0; 
+	int eid = KeySearch::lowerBound(keys(), getKeyCount(), searchKey);
+	int* s = sizes();
+	below = 0;
+	for (int i = 0; i < eid; i++) below += s[i];
+	pid = pids()[eid];
+	return 0;
 }
 
 /*
- * Insert the (key, pid) pair to the node
+ * Insert the (key, pid) pair as the eid-th entry
  * and split the node half and half with sibling.
  * The middle key after the split is returned in midKey.
  * @param key[IN] the key to insert
  * @param pid[IN] the PageId to insert
+ * @param size[IN] the number of leaf entries under pid
+ * @param eid[IN] the position of the new entry
  * @param sibling[IN] the sibling node to split with. This node MUST be empty when this function is called.
  * @param midKey[OUT] the key in the middle after the split. This key should be inserted to the parent node.
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTNonLeafNode::insertAndSplit(int key, PageId pid, int eid,
+RC BTNonLeafNode::insertAndSplit(int key, PageId pid, int size, int eid,
 								BTNonLeafNode& sibling, int& midKey)
-{ 
-	// get the eid of half of the entries
-	int halfCount = MAX_KEY_NUM / 2;
-	// get the location of the half point of the old node
-	char *halfPtr = entryPtr(halfCount);
-	// copy the first key of second half to midKey
-	memcpy(&midKey, halfPtr, sizeof(int));
-	// copy the second half to the new node except for the middle key
-	size_t secondSize = (MAX_KEY_NUM - halfCount) * (sizeof(int) + sizeof(PageId)) - 
-						sizeof(int);
-	memcpy(sibling.entryPtr(0) - sizeof(PageId), halfPtr + sizeof(int), secondSize);
-	// update # of keys of the old node
-	setKeyCount(halfCount);
-	// update # of keys of the new node (we didn't insert the middle key)
-	sibling.setKeyCount(MAX_KEY_NUM - halfCount - 1);
-	// check if key is smaller than midKey
-    // printf("hello\teid = %d\tkey = %d\tpid = %d\n",eid,key,pid);
-	if(eid <= MAX_KEY_NUM / 2)
-		// insert the new key into the old node
-		insertAtEid(key, pid, eid);
-	else
-		// insert the new key into the new node
-		sibling.insertAtEid(key, pid, (eid - MAX_KEY_NUM / 2 - 1));
-	return 0; 
-}
-
-RC BTNonLeafNode::insertAtEid(int key, const PageId& pid, int eid) {
-	// get the location of eid th entry
-	char* ptr = entryPtr(eid);
-    // get the number of keys in page
-    int count = getKeyCount();
-    // printf("count = %d\n",count);
-	// how many keys are bigger than key
-	int remain = count - eid;
-	// copy the remaining entries into buf
-    size_t remainSize = (sizeof(int)+sizeof(PageId)) * remain;
-	char buf[remainSize];
-	memcpy(buf, ptr, remainSize);
-	// write the new entry into buffer
-	writeToPtr(ptr, key, pid);
-	// copy back from buf to buffer
-	memcpy(ptr + sizeof(int) + sizeof(PageId), buf, remainSize);
+{
+	int count = getKeyCount();
+
+	// lay out the count + 1 keys and count + 2 child pointers and sizes
+	// in order. p[i] is the child pointer right before k[i].
+	vector<int> k(count + 1);
+	vector<PageId> p(count + 2);
+	vector<int> c(count + 2);
+	memcpy(&k[0], keys(), eid * sizeof(int));
+	memcpy(&k[eid + 1], keys() + eid, (count - eid) * sizeof(int));
+	k[eid] = key;
+	memcpy(&p[0], pids(), (eid + 1) * sizeof(PageId));
+	memcpy(&p[eid + 2], pids() + eid + 1, (count - eid) * sizeof(PageId));
+	p[eid + 1] = pid;
+	memcpy(&c[0], sizes(), (eid + 1) * sizeof(int));
+	memcpy(&c[eid + 2], sizes() + eid + 1, (count - eid) * sizeof(int));
+	c[eid + 1] = size;
+
+	// the middle key moves up. the keys before it stay in this node,
+	// the keys after it go to the sibling.
+	int mid = (count + 1) / 2;
+	midKey = k[mid];
+
+	setKeyCount(mid);
+	memcpy(keys(), &k[0], mid * sizeof(int));
+	memcpy(pids(), &p[0], (mid + 1) * sizeof(PageId));
+	memcpy(sizes(), &c[0], (mid + 1) * sizeof(int));
+
+	sibling.setKeyCount(count - mid);
+	memcpy(sibling.keys(), &k[mid + 1], (count - mid) * sizeof(int));
+	memcpy(sibling.pids(), &p[mid + 1], (count - mid + 1) * sizeof(PageId));
+	memcpy(sibling.sizes(), &c[mid + 1], (count - mid + 1) * sizeof(int));
+	return 0;
+}
+
+/*
+ * Insert the (key, pid) pair as the eid-th entry.
+ * @param key[IN] the key to insert
+ * @param pid[IN] the PageId to insert
+ * @param size[IN] the number of leaf entries under pid
+ * @param eid[IN] the position of the new entry
+ * @return 0 if successful. Return an error code if the node is full.
+ */
+RC BTNonLeafNode::insertAtEid(int key, PageId pid, int size, int eid)
+{
+	int count = getKeyCount();
+	if (count >= getMaxKeyCount()) return RC_NODE_FULL;
+
+	// shift the keys from eid on and the child pointers and sizes after them
+	int* k = keys();
+	PageId* p = pids();
+	int* c = sizes();
+	memmove(k + eid + 1, k + eid, (count - eid) * sizeof(int));
+	memmove(p + eid + 2, p + eid + 1, (count - eid) * sizeof(PageId));
+	memmove(c + eid + 2, c + eid + 1, (count - eid) * sizeof(int));
+	// write the new entry into the gap
+	k[eid] = key;
+	p[eid + 1] = pid;
+	c[eid + 1] = size;
 	// increase the count of keys by 1
 	setKeyCount(count + 1);
-
+	return 0;
 }
+
 /*
  * Given the searchKey, find the child-node pointer to follow and
  * output it in pid.
  * @param searchKey[IN] the searchKey that is being looked up.
  * @param pid[OUT] the pointer to the child node to follow.
+ * @param eid[OUT] the number of keys before the child.
  * @return 0 if successful. Return an error code if there is an error.
  */
 RC BTNonLeafNode::locateChildPtr(int searchKey, PageId& pid, int& eid)
-{ 
-	eid = 0;
-	int tempKey;
-	int count = getKeyCount();
-    //printf("BTNonLeafNode::locateChildPtr: count=%d\n",count);
-	// read key from each entry in the node
-	readEntry(eid, tempKey, pid);
-    //printf("BTNonLeafNode::locateChildPtr:pid = %d\n",pid);
-	while(tempKey <= searchKey && eid < count) {
-		readEntry(++eid, tempKey, pid);
-        //printf("BTNonLeafNode::locateChildPtr:pid = %d\n",pid);
-	}
-	if(eid == count)
-		return RC_NO_SUCH_RECORD;
-	return 0; 
+{
+	// the number of keys < searchKey is the child to follow. when
+	// searchKey equals a key, the left child is followed, because
+	// duplicates of the key may end the left child. the leaf chain
+	// leads to the rest of them.
+	eid = KeySearch::lowerBound(keys(), getKeyCount(), searchKey);
+	pid = pids()[eid];
+	return 0;
 }
 
 /*
  * Initialize the root node with (pid1, key, pid2).
  * @param pid1[IN] the first PageId to insert
+ * @param size1[IN] the number of leaf entries under pid1
  * @param key[IN] the key that should be inserted between the two PageIds
  * @param pid2[IN] the PageId to insert behind the key
+ * @param size2[IN] the number of leaf entries under pid2
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTNonLeafNode::initializeRoot(PageId pid1, int key, PageId pid2)
+RC BTNonLeafNode::initializeRoot(PageId pid1, int size1, int key, PageId pid2, int size2)
 {
-    printf("BTNonLeafNode::initializeRoot: pid1=%d\tkey=%d\tpid2=%d\n",pid1,key,pid2);
-	// set the key count to 1
 	setKeyCount(1);
-	// get the location of the first entry
-	char *ptr = entryPtr(0);
-	// write pid1, key
-	writeToPtr(ptr, key, pid2);
-	// write pid2,
-	memcpy(ptr - sizeof(PageId), &pid1, sizeof(PageId));
-	return 0; 
+	keys()[0] = key;
+	pids()[0] = pid1;
+	pids()[1] = pid2;
+	sizes()[0] = size1;
+	sizes()[1] = size2;
+	return 0;
 }
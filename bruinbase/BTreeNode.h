@@ -18,8 +18,26 @@
  */
 class BTLeafNode {
   public:
-    static const int MAX_KEY_NUM = 2;//84
+   /**
+    * Create a node that is filled by read().
+    */
     BTLeafNode();
+
+   /**
+    * Create a new, empty node for a PageFile with the given page size.
+    * @param pageSize[IN] the page size of the PageFile the node is written to
+    */
+    explicit BTLeafNode(int pageSize);
+    ~BTLeafNode();
+
+   /**
+    * Return the maximum number of keys the node can hold. It is derived
+    * from the page size: a page holds the key count, the next sibling
+    * pointer and the keys with their RecordIds.
+    * @return the capacity of the node
+    */
+    int getMaxKeyCount() const;
+
    /**
     * Insert the (key, rid) pair to the node.
     * Remember that all keys inside a B+tree node should be kept sorted.
@@ -33,6 +51,8 @@ class BTLeafNode {
     * Insert the (key, rid) pair to the node
     * and split the node half and half with sibling.
     * The first key of the sibling node is returned in siblingKey.
+    * The sibling takes over the next node pointer of this node; the caller
+    * has to point this node to the sibling once the sibling has a PageId.
     * Remember that all keys inside a B+tree node should be kept sorted.
     * @param key[IN] the key to insert.
     * @param rid[IN] the RecordId to insert.
@@ -40,7 +60,17 @@ class BTLeafNode {
     * @param siblingKey[OUT] the first key in the sibling node after split.
     * @return 0 if successful. Return an error code if there is an error.
     */
-    RC insertAndSplit(int key, const RecordId& rid, int eid, BTLeafNode& sibling, int& siblingKey);
+    RC insertAndSplit(int key, const RecordId& rid, BTLeafNode& sibling, int& siblingKey);
+
+   /**
+    * Insert the (key, rid) pair as the eid-th entry, shifting the
+    * following entries by one.
+    * The node must not be full.
+    * @param key[IN] the key to insert
+    * @param rid[IN] the RecordId to insert
+    * @param eid[IN] the position of the new entry
+    * @return 0 if successful. Return an error code if the node is full.
+    */
     RC insertAtEid(int key, const RecordId& rid, int eid);
    /**
     * Find the index entry whose key value is larger than or equal to searchKey
@@ -48,8 +78,9 @@ class BTLeafNode {
     * Remember that keys inside a B+tree node are sorted.
     * @param searchKey[IN] the key to search for.
     * @param eid[OUT] the entry number that contains a key larger              
-    *                 than or equalty to searchKey.
-    * @return 0 if successful. Return an error code if there is an error.
+    *                 than or equalty to searchKey. If every key is smaller,
+    *                 eid is the key count.
+    * @return 0 if successful. RC_NO_SUCH_RECORD if every key is smaller.
     */
     RC locate(int searchKey, int& eid);
 
@@ -62,6 +93,16 @@ class BTLeafNode {
     */
     RC readEntry(int eid, int& key, RecordId& rid);
 
+   /**
+    * Copy up to max (key, rid) pairs starting from the eid entry.
+    * @param eid[IN] the first entry to copy
+    * @param max[IN] the maximum number of entries to copy
+    * @param keys[OUT] the keys of the entries
+    * @param rids[OUT] the RecordIds of the entries
+    * @return the number of entries copied
+    */
+    int readEntries(int eid, int max, int* keys, RecordId* rids);
+
    /**
     * Return the pid of the next slibling node.
     * @return the PageId of the next sibling node 
@@ -89,28 +130,22 @@ class BTLeafNode {
     RC setKeyCount(int count);
 
    /**
-    * Return the pointer to the new entry in the buffer.
-    * @param n[IN] the key count to be written in buffer.
-    * @return the pointer.
-    */
-    char* entryPtr(int eid);
-
-   /**
-    * Write an entry to a given position in the buffer.
-    * @param ptr[IN] the pointer pointing to the position to insert a new entry.
-    * @param key[IN] the key to be inserted to buffer.
-    * @param rid[IN] the RecordId to be inserted to buffer.
-    * @return 0 if successful, return an error code if error occurs.
+    * Read the content of the node from the page pid in the PageFile pf.
+    * @param pid[IN] the PageId to read
+    * @param pf[IN] PageFile to read from
+    * @return 0 if successful. Return an error code if there is an error.
     */
-    RC writeToPtr(char* ptr, int key, const RecordId& rid);
+    RC read(PageId pid, const PageFile& pf);
 
    /**
-    * Read the content of the node from the page pid in the PageFile pf.
+    * Read the content of the node from the page pid into a copy owned by
+    * the node, to be changed and written back with write(). Until then
+    * the page in the buffer pool is left as it is.
     * @param pid[IN] the PageId to read
     * @param pf[IN] PageFile to read from
     * @return 0 if successful. Return an error code if there is an error.
     */
-    RC read(PageId pid, const PageFile& pf);
+    RC readCopy(PageId pid, const PageFile& pf);
     
    /**
     * Write the content of the node to the page pid in the PageFile pf.
@@ -122,10 +157,22 @@ class BTLeafNode {
 
   private:
    /**
-    * The main memory buffer for loading the content of the disk page 
-    * that contains the node.
+    * The keys of the node, stored contiguously so that they can be
+    * searched with vector compares, and the RecordIds of the keys.
+    */
+    int* keys() const { return (int*)(buffer + 2 * sizeof(int)); }
+    RecordId* rids() const { return (RecordId*)(keys() + getMaxKeyCount()); }
+
+   /**
+    * The content of the node. After read(), it points straight into the
+    * buffer pool frame pinned by page; a new node and readCopy() use
+    * local instead.
+    * Layout: [key count][next node pointer][keys][RecordIds]
     */
-    char buffer[PageFile::PAGE_SIZE];
+    char* buffer;
+    PageGuard page;
+    char* local;
+    int pageSize;
 }; 
 
 
@@ -134,49 +181,98 @@ class BTLeafNode {
  */
 class BTNonLeafNode {
   public:
+   /**
+    * Create a node that is filled by read().
+    */
     BTNonLeafNode();
-    static const int MAX_KEY_NUM = 2;//127
+
+   /**
+    * Create a new, empty node for a PageFile with the given page size.
+    * @param pageSize[IN] the page size of the PageFile the node is written to
+    */
+    explicit BTNonLeafNode(int pageSize);
+    ~BTNonLeafNode();
+
+   /**
+    * Return the maximum number of keys the node can hold. It is derived
+    * from the page size: a page holds the key count, the keys and one
+    * more child pointer than keys.
+    * @return the capacity of the node
+    */
+    int getMaxKeyCount() const;
+
    /**
     * Insert a (key, pid) pair to the node.
     * Remember that all keys inside a B+tree node should be kept sorted.
     * @param key[IN] the key to insert
     * @param pid[IN] the PageId to insert
+    * @param size[IN] the number of leaf entries under pid
     * @return 0 if successful. Return an error code if the node is full.
     */
-    RC insert(int key, PageId pid);
+    RC insert(int key, PageId pid, int size);
 
    /**
-    * Insert the (key, pid) pair to the node
+    * Insert the (key, pid) pair as the eid-th entry
     * and split the node half and half with sibling.
     * The sibling node MUST be empty when this function is called.
     * The middle key after the split is returned in midKey.
-    * Remember that all keys inside a B+tree node should be kept sorted.
+    * The position is given explicitly, because with duplicate keys
+    * the key alone does not tell which child pid was split from.
     * @param key[IN] the key to insert
     * @param pid[IN] the PageId to insert
+    * @param size[IN] the number of leaf entries under pid
+    * @param eid[IN] the position of the new entry
     * @param sibling[IN] the sibling node to split with. This node MUST be empty when this function is called.
     * @param midKey[OUT] the key in the middle after the split. This key should be inserted to the parent node.
     * @return 0 if successful. Return an error code if there is an error.
     */
-    RC insertAndSplit(int key, PageId pid, int eid, BTNonLeafNode& sibling, int& midKey);
-    RC insertAtEid(int key, const PageId& pid, int eid);
+    RC insertAndSplit(int key, PageId pid, int size, int eid, BTNonLeafNode& sibling, int& midKey);
+
+   /**
+    * Insert the (key, pid) pair as the eid-th entry, shifting the
+    * following entries by one. pid becomes the child pointer right
+    * after key. The node must not be full.
+    * @param key[IN] the key to insert
+    * @param pid[IN] the PageId to insert
+    * @param size[IN] the number of leaf entries under pid
+    * @param eid[IN] the position of the new entry
+    * @return 0 if successful. Return an error code if the node is full.
+    */
+    RC insertAtEid(int key, PageId pid, int size, int eid);
+
    /**
     * Given the searchKey, find the child-node pointer to follow and
     * output it in pid.
     * Remember that the keys inside a B+tree node are sorted.
     * @param searchKey[IN] the searchKey that is being looked up.
     * @param pid[OUT] the pointer to the child node to follow.
+    * @param eid[OUT] the number of keys before the child. a sibling split
+    *                 from the child is inserted as the eid-th entry.
     * @return 0 if successful. Return an error code if there is an error.
     */
     RC locateChildPtr(int searchKey, PageId& pid, int& eid);
 
+   /**
+    * Count the leaf entries under the children before the one searchKey
+    * belongs to, and find that child as locateChildPtr() does.
+    * All keys under the children before it are smaller than searchKey.
+    * @param searchKey[IN] the key to count up to
+    * @param pid[OUT] the child searchKey belongs to
+    * @param below[OUT] the number of entries under the children before pid
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC countBelow(int searchKey, PageId& pid, int& below);
+
    /**
     * Initialize the root node with (pid1, key, pid2).
     * @param pid1[IN] the first PageId to insert
+    * @param size1[IN] the number of leaf entries under pid1
     * @param key[IN] the key that should be inserted between the two PageIds
     * @param pid2[IN] the PageId to insert behind the key
+    * @param size2[IN] the number of leaf entries under pid2
     * @return 0 if successful. Return an error code if there is an error.
     */
-    RC initializeRoot(PageId pid1, int key, PageId pid2);
+    RC initializeRoot(PageId pid1, int size1, int key, PageId pid2, int size2);
 
    /**
     * Return the number of keys stored in the node.
@@ -191,30 +287,43 @@ class BTNonLeafNode {
     */
     RC setKeyCount(int count);
 
-   /**
-    * Return the pointer to the new entry in the buffer.
-    * @param n[IN] the key count to be written in buffer.
-    * @return the pointer.
+    /**
+    * Read the (key, pid) pair from the eid entry.
+    * pid is the child pointer right after key.
+    * @param eid[IN] the entry number to read the (key, pid) pair from
+    * @param key[OUT] the key from the slot
+    * @param pid[OUT] the PageId from the slot
+    * @return 0 if successful. Return an error code if there is an error.
     */
-    char* entryPtr(int eid);
+    RC readEntry(int eid, int& key, PageId& pid);
 
-   /**
-    * Write an entry to a given position in the buffer.
-    * @param ptr[IN] the pointer pointing to the position to insert a new entry.
-    * @param key[IN] the key to be inserted to buffer.
-    * @param rid[IN] the RecordId to be inserted to buffer.
-    * @return 0 if successful, return an error code if error occurs.
+    /**
+    * Return the eid-th child pointer, the child before the eid-th key.
+    * @param eid[IN] the child number, 0 to getKeyCount()
+    * @return the PageId of the child. -1 if eid is out of range
     */
-    RC writeToPtr(char* ptr, int key, const PageId& pid);
+    PageId getChildPtr(int eid);
 
     /**
-    * Read the (key, rid) pair from the eid entry.
-    * @param eid[IN] the entry number to read the (key, rid) pair from
-    * @param key[OUT] the key from the slot
-    * @param rid[OUT] the RecordId from the slot
-    * @return 0 if successful. Return an error code if there is an error.
+    * Return the number of leaf entries under the eid-th child.
+    * @param eid[IN] the child number, 0 to getKeyCount()
+    * @return the number of entries. -1 if eid is out of range
     */
-    RC readEntry(int eid, int& key, PageId& pid);
+    int getSubtreeSize(int eid);
+
+    /**
+    * Set the number of leaf entries under the eid-th child.
+    * @param eid[IN] the child number, 0 to getKeyCount()
+    * @param size[IN] the number of entries
+    * @return 0 if successful. Return an error code if eid is out of range.
+    */
+    RC setSubtreeSize(int eid, int size);
+
+    /**
+    * Return the number of leaf entries under the node.
+    * @return the sum of the sizes of all children
+    */
+    int getEntryCount();
 
    /**
     * Read the content of the node from the page pid in the PageFile pf.
@@ -223,6 +332,16 @@ class BTNonLeafNode {
     * @return 0 if successful. Return an error code if there is an error.
     */
     RC read(PageId pid, const PageFile& pf);
+
+   /**
+    * Read the content of the node from the page pid into a copy owned by
+    * the node, to be changed and written back with write(). Until then
+    * the page in the buffer pool is left as it is.
+    * @param pid[IN] the PageId to read
+    * @param pf[IN] PageFile to read from
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC readCopy(PageId pid, const PageFile& pf);
     
    /**
     * Write the content of the node to the page pid in the PageFile pf.
@@ -234,10 +353,25 @@ class BTNonLeafNode {
 
   private:
    /**
-    * The main memory buffer for loading the content of the disk page 
-    * that contains the node.
+    * The keys of the node, stored contiguously so that they can be
+    * searched with vector compares, the child pointers, and the number
+    * of leaf entries under each child. pids()[i] is the child right
+    * before keys()[i], and sizes()[i] counts the entries under it.
+    */
+    int* keys() const { return (int*)(buffer + sizeof(int)); }
+    PageId* pids() const { return (PageId*)(keys() + getMaxKeyCount()); }
+    int* sizes() const { return (int*)(pids() + getMaxKeyCount() + 1); }
+
+   /**
+    * The content of the node. After read(), it points straight into the
+    * buffer pool frame pinned by page; a new node and readCopy() use
+    * local instead.
+    * Layout: [key count][keys][child pointers][subtree sizes]
     */
-    char buffer[PageFile::PAGE_SIZE];
+    char* buffer;
+    PageGuard page;
+    char* local;
+    int pageSize;
 }; 
 
 #endif /* BTNODE_H */
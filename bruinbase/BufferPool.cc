@@ -0,0 +1,513 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include "Bruinbase.h"
+#include "BufferPool.h"
+
+BufferPool* BufferPool::pool = NULL;
+int BufferPool::sizeMB = BufferPool::DEFAULT_SIZE_MB;
+
+BufferPool& BufferPool::instance()
+{
+  // the pool is created lazily so that configure() can run first
+  if (pool == NULL) pool = new BufferPool(sizeMB);
+  return *pool;
+}
+
+RC BufferPool::configure(int megabytes)
+{
+  if (megabytes <= 0) return RC_INVALID_ATTRIBUTE;
+
+  sizeMB = megabytes;
+  if (pool != NULL) {
+    delete pool;
+    pool = NULL;
+  }
+  return 0;
+}
+
+BufferPool::BufferPool(int megabytes)
+{
+  // split the memory evenly over the shards. there are enough frames
+  // to spend the whole budget on the smallest pages.
+  long capacity = ((long)megabytes << 20) / SHARD_COUNT;
+  int perShard = (int)(capacity / PageFile::MIN_PAGE_SIZE);
+  if (perShard < MIN_SHARD_FRAMES) perShard = MIN_SHARD_FRAMES;
+
+  for (int i = 0; i < SHARD_COUNT; i++) {
+    Shard& s = shards[i];
+    pthread_mutex_init(&s.latch, NULL);
+    pthread_cond_init(&s.loaded, NULL);
+    s.frameCount = perShard;
+    s.frames = new Frame[perShard];
+    s.capacity = capacity;
+    s.used = 0;
+    s.attached = 0;
+    // keep the chains short: about one frame per bucket
+    s.bucketCount = perShard;
+    s.buckets = new int[s.bucketCount];
+    s.clockHand = 0;
+    s.dirtyCount = 0;
+    s.dirtyBytes = 0;
+    memset(&s.stats, 0, sizeof(Stats));
+
+    for (int b = 0; b < s.bucketCount; b++) s.buckets[b] = -1;
+    for (int f = 0; f < perShard; f++) {
+      s.frames[f].fd = -1;
+      s.frames[f].pid = -1;
+      s.frames[f].refBit = 0;
+      s.frames[f].pinCount = 0;
+      s.frames[f].dirty = 0;
+      s.frames[f].reading = 0;
+      s.frames[f].owner = NULL;
+      s.frames[f].next = -1;
+      s.frames[f].data = NULL;
+      s.frames[f].size = 0;
+    }
+  }
+}
+
+BufferPool::~BufferPool()
+{
+  for (int i = 0; i < SHARD_COUNT; i++) {
+    pthread_cond_destroy(&shards[i].loaded);
+    pthread_mutex_destroy(&shards[i].latch);
+    for (int f = 0; f < shards[i].frameCount; f++) free(shards[i].frames[f].data);
+    delete [] shards[i].frames;
+    delete [] shards[i].buckets;
+  }
+}
+
+BufferPool::Shard& BufferPool::shardOf(int fd, PageId pid)
+{
+  // consecutive pages of a file go to different shards
+  unsigned h = (unsigned)pid * 2654435761u ^ (unsigned)fd * 40503u;
+  return shards[h % SHARD_COUNT];
+}
+
+int BufferPool::bucketOf(const Shard& s, int fd, PageId pid)
+{
+  unsigned h = (unsigned)pid * 2246822519u + (unsigned)fd * 3266489917u;
+  return (int)(h % (unsigned)s.bucketCount);
+}
+
+int BufferPool::lookup(Shard& s, int fd, PageId pid)
+{
+  for (int f = s.buckets[bucketOf(s, fd, pid)]; f >= 0; f = s.frames[f].next) {
+    if (s.frames[f].fd == fd && s.frames[f].pid == pid) return f;
+  }
+  return -1;
+}
+
+int BufferPool::settled(Shard& s, int fd, PageId pid)
+{
+  int f;
+  while ((f = lookup(s, fd, pid)) >= 0 && s.frames[f].reading) {
+    pthread_cond_wait(&s.loaded, &s.latch);
+  }
+  return f;
+}
+
+void BufferPool::unlink(Shard& s, int f)
+{
+  int* link = &s.buckets[bucketOf(s, s.frames[f].fd, s.frames[f].pid)];
+  while (*link != f) link = &s.frames[*link].next;
+  *link = s.frames[f].next;
+  s.frames[f].next = -1;
+}
+
+void BufferPool::attach(Shard& s, int f, int size)
+{
+  // aligned so that O_DIRECT can read a page straight into the frame
+  void* data = NULL;
+  if (posix_memalign(&data, PageFile::DIRECT_ALIGN, size) != 0) data = NULL;
+  s.frames[f].data = (char*)data;
+  s.frames[f].size = size;
+  s.used += size;
+  s.attached++;
+}
+
+void BufferPool::detach(Shard& s, int f)
+{
+  free(s.frames[f].data);
+  s.used -= s.frames[f].size;
+  s.attached--;
+  s.frames[f].data = NULL;
+  s.frames[f].size = 0;
+}
+
+int BufferPool::victim(Shard& s, int size)
+{
+  // while the budget allows, take an empty frame instead of evicting a page
+  if (s.used + size <= s.capacity || s.attached < MIN_SHARD_FRAMES) {
+    for (int f = 0; f < s.frameCount; f++) {
+      if (s.frames[f].fd < 0 && s.frames[f].pinCount == 0 && s.frames[f].size == 0) {
+        attach(s, f, size);
+        return f;
+      }
+    }
+  }
+
+  // sweep the clock hand, giving recently used frames a second chance.
+  // after two full rounds every unpinned frame has lost its reference bit,
+  // and a third one frees enough memory for a page of any size.
+  for (int n = 0; n < 3 * s.frameCount; n++) {
+    Frame& fr = s.frames[s.clockHand];
+    int f = s.clockHand;
+    s.clockHand = (s.clockHand + 1) % s.frameCount;
+
+    if (fr.pinCount > 0) continue;
+    if (fr.fd >= 0) {
+      if (fr.refBit) {
+        fr.refBit = 0;
+        continue;
+      }
+      if (fr.dirty) {
+        // write the page back without the latch, like flush(). the frame
+        // is pinned meanwhile so that no other thread takes it
+        PageFile* owner = fr.owner;
+        PageId pid = fr.pid;
+        char* data = fr.data;
+        fr.dirty = 0;
+        s.dirtyCount--;
+        s.dirtyBytes -= fr.size;
+        fr.pinCount++;
+        pthread_mutex_unlock(&s.latch);
+        RC rc = owner->writePages(pid, &data, 1);
+        pthread_mutex_lock(&s.latch);
+        fr.pinCount--;
+
+        // keep the frame if the page cannot be written back
+        if (rc < 0) {
+          if (fr.fd >= 0 && !fr.dirty) {
+            fr.dirty = 1;
+            s.dirtyCount++;
+            s.dirtyBytes += fr.size;
+          }
+          continue;
+        }
+        s.stats.writebacks++;
+
+        // the page may have been used or written again in the meantime
+        if (fr.pinCount > 0 || fr.dirty || fr.refBit) continue;
+      }
+      // the file of the page may have been closed in the meantime
+      if (fr.fd >= 0) {
+        unlink(s, f);
+        fr.fd = -1;
+        s.stats.evictions++;
+      }
+    }
+
+    // reuse the memory of the frame if it has the right size.
+    // otherwise give it back and keep sweeping until the page fits.
+    if (fr.size == size) return f;
+    if (fr.size > 0) detach(s, f);
+    if (s.used + size <= s.capacity || s.attached < MIN_SHARD_FRAMES) {
+      attach(s, f, size);
+      return f;
+    }
+  }
+  return -1;
+}
+
+int BufferPool::locate(Shard& s, const PageFile& file, int fd, PageId pid, RC& rc)
+{
+  int f;
+  rc = 0;
+
+  for (;;) {
+    // if the page is cached, use the frame
+    if ((f = settled(s, fd, pid)) >= 0) {
+      s.stats.hits++;
+      s.frames[f].refBit = 1;
+      return f;
+    }
+
+    // take a free or evicted frame, unless another thread cached the
+    // page while a victim was written back
+    if ((f = victim(s, file.getPageSize())) < 0) {
+      rc = RC_BUFFER_POOL_FULL;
+      return -1;
+    }
+    if (lookup(s, fd, pid) < 0) break;
+  }
+  s.stats.misses++;
+
+  // claim the frame for the page and read it without the latch.
+  // the frame is pinned so that it is not evicted during the read
+  Frame& fr = s.frames[f];
+  assign(s, f, fd, pid);
+  fr.reading = 1;
+  fr.pinCount++;
+  pthread_mutex_unlock(&s.latch);
+  rc = file.readPage(pid, fr.data);
+  pthread_mutex_lock(&s.latch);
+  fr.reading = 0;
+  fr.pinCount--;
+  pthread_cond_broadcast(&s.loaded);
+
+  // on error, the threads waiting for the page try to read it themselves
+  if (rc < 0) {
+    if (fr.fd == fd && fr.pid == pid) {
+      unlink(s, f);
+      fr.fd = -1;
+    }
+    return -1;
+  }
+  return f;
+}
+
+void BufferPool::assign(Shard& s, int f, int fd, PageId pid)
+{
+  Frame& fr = s.frames[f];
+  fr.fd = fd;
+  fr.pid = pid;
+  fr.refBit = 1;
+  int b = bucketOf(s, fd, pid);
+  fr.next = s.buckets[b];
+  s.buckets[b] = f;
+}
+
+RC BufferPool::read(const PageFile& file, int fd, PageId pid, void* buffer)
+{
+  RC rc;
+  Shard& s = shardOf(fd, pid);
+
+  pthread_mutex_lock(&s.latch);
+  int f = locate(s, file, fd, pid, rc);
+  if (f >= 0) memcpy(buffer, s.frames[f].data, s.frames[f].size);
+  pthread_mutex_unlock(&s.latch);
+
+  return rc;
+}
+
+RC BufferPool::pin(const PageFile& file, int fd, PageId pid, PageGuard& page)
+{
+  RC rc;
+  Shard& s = shardOf(fd, pid);
+
+  pthread_mutex_lock(&s.latch);
+  int f = locate(s, file, fd, pid, rc);
+  if (f >= 0) {
+    s.frames[f].pinCount++;
+    page.page = s.frames[f].data;
+    page.pageId = pid;
+    page.shard = (int)(&s - shards);
+    page.frame = f;
+  }
+  pthread_mutex_unlock(&s.latch);
+
+  return rc;
+}
+
+RC BufferPool::load(const PageFile& file, int fd, const PageId* pids, int count)
+{
+  RC rc;
+  std::vector<PageId> missing;
+
+  // leave out the pages that are cached
+  for (int i = 0; i < count; i++) {
+    Shard& s = shardOf(fd, pids[i]);
+    pthread_mutex_lock(&s.latch);
+    if (lookup(s, fd, pids[i]) < 0) missing.push_back(pids[i]);
+    pthread_mutex_unlock(&s.latch);
+  }
+  if (missing.empty()) return 0;
+
+  // read the missing pages together, without holding a latch
+  int n = missing.size();
+  int size = file.getPageSize();
+  std::vector<char> block((size_t)n * size);
+  std::vector<char*> buffers(n);
+  for (int i = 0; i < n; i++) buffers[i] = &block[(size_t)i * size];
+  if ((rc = file.readBatch(&missing[0], &buffers[0], n)) < 0) return rc;
+
+  // the page may have been loaded by another thread in the meantime
+  for (int i = 0; i < n; i++) {
+    Shard& s = shardOf(fd, missing[i]);
+    pthread_mutex_lock(&s.latch);
+    if (lookup(s, fd, missing[i]) < 0) {
+      int f = victim(s, size);
+      if (f >= 0 && lookup(s, fd, missing[i]) < 0) {
+        memcpy(s.frames[f].data, buffers[i], size);
+        assign(s, f, fd, missing[i]);
+        s.stats.misses++;
+      }
+    }
+    pthread_mutex_unlock(&s.latch);
+  }
+  return 0;
+}
+
+void BufferPool::unpin(const PageGuard& page)
+{
+  Shard& s = shards[page.shard];
+
+  pthread_mutex_lock(&s.latch);
+  s.frames[page.frame].pinCount--;
+  pthread_mutex_unlock(&s.latch);
+}
+
+RC BufferPool::install(PageFile& file, int fd, PageId pid, const void* buffer, bool& crowded)
+{
+  Shard& s = shardOf(fd, pid);
+
+  pthread_mutex_lock(&s.latch);
+
+  // the page is overwritten, so a missing page needs no disk read.
+  // a read of the page in progress must not overwrite it afterwards
+  int f = settled(s, fd, pid);
+  if (f < 0) {
+    if ((f = victim(s, file.getPageSize())) < 0) {
+      pthread_mutex_unlock(&s.latch);
+      return RC_BUFFER_POOL_FULL;
+    }
+    // the page may have been cached while a victim was written back
+    int g = settled(s, fd, pid);
+    if (g >= 0) f = g;
+    else assign(s, f, fd, pid);
+  }
+
+  // the buffer may be the pinned frame itself
+  Frame& fr = s.frames[f];
+  if (fr.data != buffer) memcpy(fr.data, buffer, fr.size);
+  fr.refBit = 1;
+  fr.owner = &file;
+  if (!fr.dirty) {
+    fr.dirty = 1;
+    s.dirtyCount++;
+    s.dirtyBytes += fr.size;
+  }
+  crowded = (s.dirtyBytes * 100 >= s.capacity * DIRTY_PERCENT);
+
+  pthread_mutex_unlock(&s.latch);
+  return 0;
+}
+
+// a dirty page collected by flush()
+struct DirtyPage {
+  PageId pid;
+  int    shard;
+  int    frame;
+  char*  data;
+};
+
+static bool pidLess(const DirtyPage& a, const DirtyPage& b)
+{
+  return a.pid < b.pid;
+}
+
+RC BufferPool::flush(PageFile& file, int fd)
+{
+  RC rc = 0;
+  std::vector<DirtyPage> pages;
+
+  // collect and pin the dirty pages of the file, marking them clean.
+  // a page written again during the flush becomes dirty again.
+  for (int i = 0; i < SHARD_COUNT; i++) {
+    Shard& s = shards[i];
+    pthread_mutex_lock(&s.latch);
+    for (int f = 0; f < s.frameCount; f++) {
+      Frame& fr = s.frames[f];
+      if (fr.fd != fd || !fr.dirty) continue;
+      DirtyPage p = { fr.pid, i, f, fr.data };
+      pages.push_back(p);
+      fr.pinCount++;
+      fr.dirty = 0;
+      s.dirtyCount--;
+      s.dirtyBytes -= fr.size;
+    }
+    pthread_mutex_unlock(&s.latch);
+  }
+
+  // write the pages in pid order
+  std::sort(pages.begin(), pages.end(), pidLess);
+  if (!pages.empty()) {
+    std::vector<PageId> pids;
+    std::vector<char*> data;
+    for (size_t i = 0; i < pages.size(); i++) {
+      pids.push_back(pages[i].pid);
+      data.push_back(pages[i].data);
+    }
+    rc = file.writeBatch(&pids[0], &data[0], (int)pages.size());
+  }
+
+  // unpin the pages. on error, keep them dirty so that nothing is lost
+  for (size_t i = 0; i < pages.size(); i++) {
+    Shard& s = shards[pages[i].shard];
+    pthread_mutex_lock(&s.latch);
+    Frame& fr = s.frames[pages[i].frame];
+    fr.pinCount--;
+    if (rc < 0 && !fr.dirty) {
+      fr.dirty = 1;
+      s.dirtyCount++;
+      s.dirtyBytes += fr.size;
+    }
+    if (rc == 0) s.stats.writebacks++;
+    pthread_mutex_unlock(&s.latch);
+  }
+
+  return rc;
+}
+
+void BufferPool::update(int fd, PageId pid, const void* buffer)
+{
+  Shard& s = shardOf(fd, pid);
+
+  pthread_mutex_lock(&s.latch);
+  // the buffer may be the pinned frame itself
+  int f = settled(s, fd, pid);
+  if (f >= 0 && s.frames[f].data != buffer) {
+    memcpy(s.frames[f].data, buffer, s.frames[f].size);
+  }
+  pthread_mutex_unlock(&s.latch);
+}
+
+void BufferPool::discard(int fd)
+{
+  for (int i = 0; i < SHARD_COUNT; i++) {
+    Shard& s = shards[i];
+    pthread_mutex_lock(&s.latch);
+    for (int f = 0; f < s.frameCount; f++) {
+      // a frame still pinned after close is only dropped from the table,
+      // so the handle holding it stays valid until it is released
+      if (s.frames[f].fd == fd) {
+        unlink(s, f);
+        s.frames[f].fd = -1;
+        s.frames[f].pid = -1;
+        s.frames[f].refBit = 0;
+        if (s.frames[f].dirty) {
+          s.dirtyCount--;
+          s.dirtyBytes -= s.frames[f].size;
+        }
+        s.frames[f].dirty = 0;
+        s.frames[f].owner = NULL;
+      }
+    }
+    pthread_mutex_unlock(&s.latch);
+  }
+}
+
+BufferPool::Stats BufferPool::getStats()
+{
+  Stats total;
+  memset(&total, 0, sizeof(Stats));
+
+  for (int i = 0; i < SHARD_COUNT; i++) {
+    pthread_mutex_lock(&shards[i].latch);
+    total.hits += shards[i].stats.hits;
+    total.misses += shards[i].stats.misses;
+    total.evictions += shards[i].stats.evictions;
+    total.writebacks += shards[i].stats.writebacks;
+    pthread_mutex_unlock(&shards[i].latch);
+  }
+  return total;
+}
@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <pthread.h>
+#include "Bruinbase.h"
+#include "PageFile.h"
+
+/**
+ * The page cache shared by every open PageFile.
+ * Pages are looked up by (fd, pid) in a hash table. The frames are split
+ * into SHARD_COUNT shards, each protected by its own latch, so that
+ * threads touching different pages rarely wait for each other.
+ * Inside a shard, frames are replaced with the CLOCK policy.
+ * Files may use different page sizes, so the memory of a frame is sized
+ * to its page and each shard keeps its frames within a byte budget.
+ * A frame pinned through a PageGuard is never replaced.
+ * The disk is never read or written with a shard latch held: a frame
+ * being read is pinned and marked so that threads asking for its page
+ * wait for the read, and a dirty victim is written back while pinned.
+ * In write-back mode, written pages stay dirty in their frames until
+ * the file is flushed or the frame is chosen for replacement.
+ */
+class BufferPool {
+ public:
+
+  static const int DEFAULT_SIZE_MB = 4;  // pool size unless configured
+  static const int SHARD_COUNT = 8;      // # of independently latched shards
+  static const int MIN_SHARD_FRAMES = 8; // frames a shard may always hold,
+                                         // even beyond its byte budget
+  static const int DIRTY_PERCENT = 75;   // dirty share of a shard that
+                                         // triggers an early flush
+
+  /**
+   * the hit/miss/eviction counters of the pool.
+   */
+  struct Stats {
+    long hits;       // lookups served from a frame
+    long misses;     // lookups that had to read the disk
+    long evictions;  // frames reused for a different page
+    long writebacks; // dirty pages written to the disk
+  };
+
+  /**
+   * @return the pool shared by all PageFiles
+   */
+  static BufferPool& instance();
+
+  /**
+   * set the size of the shared pool. the pool is rebuilt, so this
+   * function must be called while no PageFile is open.
+   * @param megabytes[IN] the total size of the page frames in MB
+   * @return error code. 0 if no error
+   */
+  static RC configure(int megabytes);
+
+  /**
+   * copy the page (fd, pid) into buffer. if the page is not cached,
+   * it is read from the disk through file and kept in a frame.
+   * @param file[IN] the PageFile that owns fd
+   * @param fd[IN] the file descriptor of the page
+   * @param pid[IN] the page to read
+   * @param buffer[OUT] the memory to copy the page to
+   * @return error code. 0 if no error
+   */
+  RC read(const PageFile& file, int fd, PageId pid, void* buffer);
+
+  /**
+   * pin the page (fd, pid) in a frame. if the page is not cached,
+   * it is read from the disk through file first.
+   * @param file[IN] the PageFile that owns fd
+   * @param fd[IN] the file descriptor of the page
+   * @param pid[IN] the page to pin
+   * @param page[OUT] the handle to the pinned frame
+   * @return error code. 0 if no error
+   */
+  RC pin(const PageFile& file, int fd, PageId pid, PageGuard& page);
+
+  /**
+   * read the pages of fd that are not cached into frames, all at once
+   * through PageFile::readBatch(). a page is left out if its shard has
+   * no frame to spare.
+   * @param file[IN] the PageFile that owns fd
+   * @param fd[IN] the file descriptor of the pages
+   * @param pids[IN] the pages to load
+   * @param count[IN] the number of pages
+   * @return error code. 0 if no error
+   */
+  RC load(const PageFile& file, int fd, const PageId* pids, int count);
+
+  /**
+   * unpin the frame held by page. called by PageGuard::release().
+   * @param page[IN] the handle to the pinned frame
+   */
+  void unpin(const PageGuard& page);
+
+  /**
+   * refresh the cached copy of (fd, pid) after it was written to the disk.
+   * nothing is done if the page is not cached.
+   * @param fd[IN] the file descriptor of the page
+   * @param pid[IN] the page that was written
+   * @param buffer[IN] the new content of the page
+   */
+  void update(int fd, PageId pid, const void* buffer);
+
+  /**
+   * copy buffer into the frame of (fd, pid) and mark the frame dirty.
+   * the page is not read from the disk, because it is overwritten.
+   * @param file[IN] the PageFile that owns fd. it writes the page back
+   * @param fd[IN] the file descriptor of the page
+   * @param pid[IN] the page that is written
+   * @param buffer[IN] the new content of the page
+   * @param crowded[OUT] true if dirty pages fill most of the shard
+   * @return error code. 0 if no error
+   */
+  RC install(PageFile& file, int fd, PageId pid, const void* buffer, bool& crowded);
+
+  /**
+   * write all dirty pages of fd to the disk in pid order,
+   * with one call to PageFile::writeBatch().
+   * @param file[IN] the PageFile that owns fd
+   * @param fd[IN] the file descriptor of the pages
+   * @return error code. 0 if no error
+   */
+  RC flush(PageFile& file, int fd);
+
+  /**
+   * drop every cached page of fd. called when the file is closed.
+   * @param fd[IN] the file descriptor whose pages are dropped
+   */
+  void discard(int fd);
+
+  /**
+   * @return the sum of the counters of all shards
+   */
+  Stats getStats();
+
+  /**
+   * @return the total size of the page frames in bytes
+   */
+  long getCapacity() const { return (long)sizeMB << 20; }
+
+ private:
+  BufferPool(int megabytes);
+  ~BufferPool();
+  BufferPool(const BufferPool&);
+  BufferPool& operator=(const BufferPool&);
+
+  struct Frame {
+    int    fd;       // file id of the cached page. -1 if the frame is empty
+    PageId pid;      // page id of the cached page
+    int    refBit;   // set on every access, cleared by the clock hand
+    int    pinCount; // # of PageGuards holding the frame
+    int    dirty;    // the frame is newer than the disk page
+    int    reading;  // the page is being read into data from the disk
+    PageFile* owner; // the file that writes a dirty frame back
+    int    next;     // next frame in the same hash bucket. -1 at the end
+    char*  data;     // the page content
+    int    size;     // the size of data. 0 if no memory is attached
+  };
+
+  struct Shard {
+    pthread_mutex_t latch;
+    pthread_cond_t  loaded;  // a frame finished reading
+    Frame*  frames;
+    int     frameCount;
+    long    capacity;    // byte budget of the frame memory
+    long    used;        // bytes attached to frames
+    int     attached;    // # of frames with memory
+    int*    buckets;     // heads of the hash chains. -1 if empty
+    int     bucketCount;
+    int     clockHand;   // next frame to consider for eviction
+    int     dirtyCount;  // # of dirty frames
+    long    dirtyBytes;  // bytes of the dirty frames
+    Stats   stats;
+  };
+
+  // pick the shard of a page
+  Shard& shardOf(int fd, PageId pid);
+
+  // the bucket of a page inside its shard
+  static int bucketOf(const Shard& s, int fd, PageId pid);
+
+  // find the frame of a page. -1 if the page is not cached
+  static int lookup(Shard& s, int fd, PageId pid);
+
+  // unlink frame f from its hash chain
+  static void unlink(Shard& s, int f);
+
+  // find the frame of a page like lookup(), waiting for a read of the
+  // page in progress to finish
+  static int settled(Shard& s, int fd, PageId pid);
+
+  // choose a frame with size bytes of memory, evicting pages with the
+  // CLOCK policy if needed. -1 if all are pinned.
+  // a dirty victim is written back first, with the shard latch released,
+  // so the page asked for may have been cached by another thread meanwhile
+  static int victim(Shard& s, int size);
+
+  // attach or release the memory of frame f
+  static void attach(Shard& s, int f, int size);
+  static void detach(Shard& s, int f);
+
+  // link frame f as the frame of (fd, pid)
+  static void assign(Shard& s, int f, int fd, PageId pid);
+
+  // find or load the frame of a page. the shard latch must be held.
+  // it is released while the page is read from the disk
+  static int locate(Shard& s, const PageFile& file, int fd, PageId pid, RC& rc);
+
+  Shard shards[SHARD_COUNT];
+
+  static BufferPool* pool;
+  static int sizeMB;
+};
+
+#endif // BUFFERPOOL_H
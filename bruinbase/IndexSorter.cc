@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <algorithm>
+#include "IndexSorter.h"
+
+using namespace std;
+
+// stdio buffer of a run file
+static const int RUN_BUFFER_SIZE = 65536;
+
+IndexSorter::IndexSorter(int megabytes)
+{
+  capacity = ((size_t)megabytes << 20) / sizeof(Entry);
+  if (capacity == 0) capacity = 1;
+  cursor = 0;
+  count = 0;
+}
+
+IndexSorter::~IndexSorter()
+{
+  for (unsigned i = 0; i < runs.size(); i++) {
+    if (runs[i].fp != NULL) fclose(runs[i].fp);
+  }
+}
+
+bool IndexSorter::less(const Entry& e1, const Entry& e2)
+{
+  if (e1.key != e2.key) return e1.key < e2.key;
+  return e1.rid < e2.rid;
+}
+
+RC IndexSorter::add(int key, const RecordId& rid)
+{
+  RC rc;
+
+  // write a run when the memory budget is used up
+  if (entries.size() >= capacity) {
+    if ((rc = spill()) < 0) return rc;
+  }
+
+  Entry e;
+  e.key = key;
+  e.rid = rid;
+  entries.push_back(e);
+  count++;
+
+  return 0;
+}
+
+RC IndexSorter::spill()
+{
+  Run run;
+
+  std::sort(entries.begin(), entries.end(), less);
+
+  // the run file is removed automatically when it is closed
+  if ((run.fp = tmpfile()) == NULL) return RC_FILE_OPEN_FAILED;
+  setvbuf(run.fp, NULL, _IOFBF, RUN_BUFFER_SIZE);
+  runs.push_back(run);
+
+  if (fwrite(&entries[0], sizeof(Entry), entries.size(), run.fp) != entries.size()) {
+    return RC_FILE_WRITE_FAILED;
+  }
+  entries.clear();
+
+  return 0;
+}
+
+RC IndexSorter::sort()
+{
+  RC rc;
+
+  // everything fits into memory. no need for the disk
+  if (runs.empty()) {
+    std::sort(entries.begin(), entries.end(), less);
+    cursor = 0;
+    return 0;
+  }
+
+  // write the rest as the last run and release the memory
+  if (!entries.empty()) {
+    if ((rc = spill()) < 0) return rc;
+  }
+  vector<Entry>().swap(entries);
+
+  // read the first pair of every run and order the runs by it
+  for (unsigned r = 0; r < runs.size(); r++) {
+    if (fseek(runs[r].fp, 0, SEEK_SET) < 0) return RC_FILE_SEEK_FAILED;
+    if ((rc = advance(r)) < 0) return rc;
+    if (runs[r].fp != NULL) heap.push_back(r);
+  }
+  for (int i = (int)heap.size() / 2 - 1; i >= 0; i--) siftDown(i);
+
+  return 0;
+}
+
+RC IndexSorter::advance(int r)
+{
+  Run& run = runs[r];
+
+  if (fread(&run.head, sizeof(Entry), 1, run.fp) == 1) return 0;
+  if (ferror(run.fp)) return RC_FILE_READ_FAILED;
+
+  // the run is used up
+  fclose(run.fp);
+  run.fp = NULL;
+  return 0;
+}
+
+void IndexSorter::siftDown(int i)
+{
+  int n = heap.size();
+
+  for (;;) {
+    int smallest = i;
+    int left = 2 * i + 1;
+    int right = left + 1;
+    if (left < n && less(runs[heap[left]].head, runs[heap[smallest]].head)) smallest = left;
+    if (right < n && less(runs[heap[right]].head, runs[heap[smallest]].head)) smallest = right;
+    if (smallest == i) return;
+    swap(heap[i], heap[smallest]);
+    i = smallest;
+  }
+}
+
+RC IndexSorter::next(int& key, RecordId& rid)
+{
+  RC rc;
+
+  // the pairs are in memory
+  if (runs.empty()) {
+    if (cursor >= entries.size()) return RC_END_OF_INPUT;
+    key = entries[cursor].key;
+    rid = entries[cursor].rid;
+    cursor++;
+    return 0;
+  }
+
+  // merge the runs. the run with the smallest head is at the top
+  if (heap.empty()) return RC_END_OF_INPUT;
+
+  int r = heap[0];
+  key = runs[r].head.key;
+  rid = runs[r].head.rid;
+
+  if ((rc = advance(r)) < 0) return rc;
+  if (runs[r].fp == NULL) {
+    heap[0] = heap.back();
+    heap.pop_back();
+  }
+  if (!heap.empty()) siftDown(0);
+
+  return 0;
+}
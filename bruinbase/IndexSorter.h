@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef INDEXSORTER_H
+#define INDEXSORTER_H
+
+#include <cstdio>
+#include <vector>
+#include "Bruinbase.h"
+#include "RecordFile.h"
+
+/**
+ * Sorts the (key, RecordId) pairs of an index by key.
+ * Pairs are collected in memory. When the memory budget is used up,
+ * they are sorted and written to a temporary run file, and the runs are
+ * merged when the pairs are read back. So the number of pairs is only
+ * limited by the temporary disk space.
+ */
+class IndexSorter {
+ public:
+
+  static const int DEFAULT_MEMORY_MB = 16;  // memory for unsorted pairs
+
+  /**
+   * @param megabytes[IN] the memory to collect pairs in before a run is
+   * written to the disk
+   */
+  IndexSorter(int megabytes = DEFAULT_MEMORY_MB);
+  ~IndexSorter();
+
+  /**
+   * add a (key, rid) pair. must be called before sort().
+   * @param key[IN] the key of the pair
+   * @param rid[IN] the RecordId of the pair
+   * @return error code. 0 if no error
+   */
+  RC add(int key, const RecordId& rid);
+
+  /**
+   * finish adding pairs and prepare to read them in key order.
+   * @return error code. 0 if no error
+   */
+  RC sort();
+
+  /**
+   * read the next pair in key order. pairs with equal keys are
+   * returned in RecordId order.
+   * @param key[OUT] the key of the pair
+   * @param rid[OUT] the RecordId of the pair
+   * @return error code. RC_END_OF_INPUT after the last pair
+   */
+  RC next(int& key, RecordId& rid);
+
+  /**
+   * @return the number of pairs added
+   */
+  long size() const { return count; }
+
+ private:
+  IndexSorter(const IndexSorter&);
+  IndexSorter& operator=(const IndexSorter&);
+
+  struct Entry {
+    int      key;
+    RecordId rid;
+  };
+
+  struct Run {
+    FILE* fp;    // the sorted run. NULL when it is used up
+    Entry head;  // the smallest pair of the run not yet returned
+  };
+
+  // the sort order of the pairs
+  static bool less(const Entry& e1, const Entry& e2);
+
+  // sort the pairs in memory and write them as a new run
+  RC spill();
+
+  // read the next head of run r. closes the run at its end
+  RC advance(int r);
+
+  // restore the heap order of the runs below position i
+  void siftDown(int i);
+
+  std::vector<Entry> entries;  // pairs not yet in a run
+  size_t capacity;             // # of pairs that fit into memory
+  size_t cursor;               // next pair of entries to return
+  long   count;                // # of pairs added
+
+  std::vector<Run> runs;       // the runs on the disk
+  std::vector<int> heap;       // runs ordered by their heads
+};
+
+#endif // INDEXSORTER_H
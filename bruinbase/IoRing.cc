@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "IoRing.h"
+
+IoRing* IoRing::ring = NULL;
+static pthread_once_t ringOnce = PTHREAD_ONCE_INIT;
+
+// the ring is shared with the kernel. the producer publishes its tail
+// after filling the entries, and the consumer reads the other side's
+// tail before the entries it covers
+static unsigned loadAcquire(const unsigned* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+static void storeRelease(unsigned* p, unsigned v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+
+IoRing* IoRing::instance()
+{
+  pthread_once(&ringOnce, create);
+  return ring;
+}
+
+void IoRing::create()
+{
+  IoRing* r = new IoRing();
+  if (r->setup(DEFAULT_DEPTH) < 0) {
+    delete r;
+    return;
+  }
+  ring = r;
+}
+
+IoRing::IoRing()
+{
+  ringFd = -1;
+  depth = 0;
+  sqRing = cqRing = sqes = MAP_FAILED;
+  sqRingSize = cqRingSize = sqesSize = 0;
+  memset(&stats, 0, sizeof(stats));
+  pthread_mutex_init(&latch, NULL);
+}
+
+IoRing::~IoRing()
+{
+  if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+  if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+  if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+  if (ringFd >= 0) close(ringFd);
+  pthread_mutex_destroy(&latch);
+}
+
+RC IoRing::setup(unsigned entries)
+{
+  struct io_uring_params p;
+
+  memset(&p, 0, sizeof(p));
+  ringFd = syscall(__NR_io_uring_setup, entries, &p);
+  if (ringFd < 0) {
+    ringFd = -1;
+    return RC_FILE_OPEN_FAILED;
+  }
+  depth = p.sq_entries;
+
+  // newer kernels map both queue rings with one mmap()
+  sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (cqRingSize > sqRingSize) sqRingSize = cqRingSize;
+    cqRingSize = sqRingSize;
+  }
+
+  sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                ringFd, IORING_OFF_SQ_RING);
+  if (sqRing == MAP_FAILED) return RC_FILE_OPEN_FAILED;
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    cqRing = sqRing;
+  } else {
+    cqRing = mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  ringFd, IORING_OFF_CQ_RING);
+    if (cqRing == MAP_FAILED) return RC_FILE_OPEN_FAILED;
+  }
+  sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+  sqes = mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+              ringFd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) return RC_FILE_OPEN_FAILED;
+
+  sqHead  = (unsigned*)((char*)sqRing + p.sq_off.head);
+  sqTail  = (unsigned*)((char*)sqRing + p.sq_off.tail);
+  sqMask  = (unsigned*)((char*)sqRing + p.sq_off.ring_mask);
+  sqArray = (unsigned*)((char*)sqRing + p.sq_off.array);
+  cqHead  = (unsigned*)((char*)cqRing + p.cq_off.head);
+  cqTail  = (unsigned*)((char*)cqRing + p.cq_off.tail);
+  cqMask  = (unsigned*)((char*)cqRing + p.cq_off.ring_mask);
+  cqes    = (char*)cqRing + p.cq_off.cqes;
+
+  return 0;
+}
+
+void IoRing::queue(const Request& req, int i)
+{
+  unsigned tail = *sqTail;
+  unsigned slot = tail & *sqMask;
+  struct io_uring_sqe* sqe = (struct io_uring_sqe*)sqes + slot;
+
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = req.write ? IORING_OP_WRITEV : IORING_OP_READV;
+  sqe->fd = req.fd;
+  sqe->off = req.offset;
+  sqe->addr = (unsigned long)req.iov;
+  sqe->len = req.iovcnt;
+  sqe->user_data = i;
+
+  sqArray[slot] = slot;
+  storeRelease(sqTail, tail + 1);
+}
+
+int IoRing::reap(Request* reqs)
+{
+  unsigned head = *cqHead;
+  unsigned tail = loadAcquire(cqTail);
+  int n = 0;
+
+  for (; head != tail; head++, n++) {
+    struct io_uring_cqe* cqe = (struct io_uring_cqe*)cqes + (head & *cqMask);
+    reqs[cqe->user_data].result = cqe->res;
+  }
+  storeRelease(cqHead, head);
+  return n;
+}
+
+RC IoRing::run(Request* reqs, int count)
+{
+  RC  rc = 0;
+  int next = 0;      // the next request to queue
+  int queued = 0;    // queued, but not submitted yet
+  int inFlight = 0;  // submitted or queued, but not completed
+
+  pthread_mutex_lock(&latch);
+
+  while (next < count || inFlight > 0) {
+    // keep the queue full
+    while (next < count && inFlight < (int)depth) {
+      queue(reqs[next], next);
+      next++;
+      queued++;
+      inFlight++;
+    }
+    if (inFlight > stats.maxDepth) stats.maxDepth = inFlight;
+
+    // submit the new requests and wait for at least one completion
+    int r = syscall(__NR_io_uring_enter, ringFd, queued, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    if (r < 0 && errno == EINTR) continue;
+    if (r < 0) {
+      // the kernel may have taken some of the queued requests before it
+      // failed. those complete as usual, and are waited for so that the
+      // buffers are not used after this function returns. the ones it
+      // left between the head and the tail of the queue are taken back
+      // and failed with the error of the call
+      int err = errno;
+      int left = (int)(*sqTail - loadAcquire(sqHead));
+      rc = RC_FILE_READ_FAILED;
+      for (int i = next - left; i < next; i++) reqs[i].result = -err;
+      storeRelease(sqTail, *sqTail - left);
+      inFlight -= left;
+      stats.requests += queued - left;
+      for (int i = next; i < count; i++) reqs[i].result = -ECANCELED;
+      next = count;
+      queued = 0;
+      if (inFlight == 0) break;
+      syscall(__NR_io_uring_enter, ringFd, 0, inFlight, IORING_ENTER_GETEVENTS, NULL, 0);
+    } else {
+      stats.requests += r;
+      queued -= r;
+    }
+    stats.calls++;
+
+    int done = reap(reqs);
+    stats.completed += done;
+    inFlight -= done;
+  }
+
+  pthread_mutex_unlock(&latch);
+  return rc;
+}
+
+IoRing::Stats IoRing::getStats()
+{
+  pthread_mutex_lock(&latch);
+  Stats s = stats;
+  pthread_mutex_unlock(&latch);
+  return s;
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef IORING_H
+#define IORING_H
+
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "Bruinbase.h"
+
+/**
+ * A Linux io_uring, set up with the raw system calls.
+ * A batch of reads and writes is put on the submission queue, up to the
+ * queue depth at a time, and the queue is refilled as requests complete,
+ * so the disk works on many pages at once and one system call submits
+ * and waits for a whole group of them.
+ * One ring is shared by all PageFiles. It is used by one batch at a time.
+ */
+class IoRing {
+ public:
+  static const unsigned DEFAULT_DEPTH = 64;  // requests in flight at most
+
+  /**
+   * one read or write of a batch.
+   */
+  struct Request {
+    int    fd;          // the file to read or write
+    off_t  offset;      // the file offset of the first byte
+    struct iovec* iov;  // the memory to read into or write from
+    int    iovcnt;
+    bool   write;       // true for a write
+    int    result;      // OUT: # of bytes transferred, or -errno
+  };
+
+  /**
+   * the counters of the ring.
+   */
+  struct Stats {
+    long requests;   // requests submitted
+    long completed;  // completions reaped
+    long calls;      // io_uring_enter() calls
+    long maxDepth;   // the most requests that were in flight at once
+  };
+
+  /**
+   * @return the shared ring, set up at the first call.
+   *   NULL if the kernel does not support io_uring
+   */
+  static IoRing* instance();
+
+  /**
+   * run a batch of requests and wait for all of them.
+   * the result of every request is set, also when some of them fail.
+   * @param reqs[IN/OUT] the requests
+   * @param count[IN] the number of requests
+   * @return error code. 0 if no error in the ring itself
+   */
+  RC run(Request* reqs, int count);
+
+  /**
+   * @return the counters of the ring
+   */
+  Stats getStats();
+
+ private:
+  IoRing();
+  ~IoRing();
+  IoRing(const IoRing&);
+  IoRing& operator=(const IoRing&);
+
+  // create the shared ring. called once
+  static void create();
+
+  // set up the ring and map its queues
+  RC setup(unsigned depth);
+
+  // put reqs[i] on the submission queue
+  void queue(const Request& req, int i);
+
+  // take the completions off the completion queue
+  int reap(Request* reqs);
+
+  int       ringFd;
+  unsigned  depth;     // # of submission queue entries
+
+  // the shared memory of the queues
+  void*     sqRing;
+  size_t    sqRingSize;
+  void*     cqRing;
+  size_t    cqRingSize;
+  void*     sqes;
+  size_t    sqesSize;
+
+  // pointers into the queues
+  unsigned* sqHead;
+  unsigned* sqTail;
+  unsigned* sqMask;
+  unsigned* sqArray;
+  unsigned* cqHead;
+  unsigned* cqTail;
+  unsigned* cqMask;
+  void*     cqes;
+
+  pthread_mutex_t latch;  // one batch at a time
+  Stats     stats;
+
+  static IoRing* ring;
+};
+
+#endif // IORING_H
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include "KeySearch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// the vector kernels binary search down to a window of this many keys
+// and compare the whole window at once
+static const int WINDOW = 16;
+
+const char* KeySearch::kernelName = "scalar";
+KeySearch::Kernel KeySearch::kernel = KeySearch::pickKernel();
+
+// the kernels of other files are picked at static initialization too,
+// so the answer is not kept in a static that may not be set yet
+bool KeySearch::hasAVX2()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
+
+KeySearch::Kernel KeySearch::pickKernel()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  if (hasAVX2()) {
+    kernelName = "avx2";
+    return avx2LowerBound;
+  }
+#endif
+  kernelName = "scalar";
+  return scalarLowerBound;
+}
+
+int KeySearch::scalarLowerBound(const int* keys, int n, int key)
+{
+  const int* base = keys;
+
+  if (n <= 0) return 0;
+
+  // the answer stays within [base, base + n]. the step is a conditional
+  // move, so the loop has no data-dependent branch to mispredict
+  while (n > 1) {
+    int half = n / 2;
+    base = (base[half] < key) ? base + half : base;
+    n -= half;
+  }
+  return (base - keys) + (*base < key);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+__attribute__((target("avx2")))
+int KeySearch::avx2LowerBound(const int* keys, int n, int key)
+{
+  const int* base = keys;
+
+  // narrow the range like the scalar kernel
+  while (n > WINDOW) {
+    int half = n / 2;
+    base = (base[half] < key) ? base + half : base;
+    n -= half;
+  }
+
+  // the keys are sorted, so the position is the number of keys < key
+  __m256i k = _mm256_set1_epi32(key);
+  int count = 0;
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(base + i));
+    int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(k, v)));
+    count += __builtin_popcount(mask);
+  }
+  for (; i < n; i++) count += (base[i] < key);
+
+  return (base - keys) + count;
+}
+
+#endif
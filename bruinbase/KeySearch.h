@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef KEYSEARCH_H
+#define KEYSEARCH_H
+
+/**
+ * Search kernels for the sorted key arrays of the B+tree nodes.
+ * The kernel is picked once at startup: AVX2 on x86 processors that
+ * support it, a branch-free scalar binary search otherwise.
+ */
+class KeySearch {
+ public:
+  /**
+   * find the first key that is larger than or equal to key.
+   * @param keys[IN] the sorted keys
+   * @param n[IN] the number of keys
+   * @param key[IN] the key to search for
+   * @return the position of the first key >= key. n if every key is smaller
+   */
+  static int lowerBound(const int* keys, int n, int key) { return kernel(keys, n, key); }
+
+  /**
+   * @return the name of the kernel in use: "avx2" or "scalar"
+   */
+  static const char* getKernelName() { return kernelName; }
+
+  /**
+   * @return true if the processor runs the AVX2 kernels. other kernels
+   * that use AVX2 are picked with it as well
+   */
+  static bool hasAVX2();
+
+ private:
+  typedef int (*Kernel)(const int* keys, int n, int key);
+
+  static int scalarLowerBound(const int* keys, int n, int key);
+#if defined(__x86_64__) || defined(__i386__)
+  static int avx2LowerBound(const int* keys, int n, int key);
+#endif
+
+  // choose the fastest kernel the processor supports
+  static Kernel pickKernel();
+
+  static Kernel kernel;
+  static const char* kernelName;
+};
+
+#endif // KEYSEARCH_H
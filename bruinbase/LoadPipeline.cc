@@ -0,0 +1,331 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "LoadPipeline.h"
+#include "TableStats.h"
+
+using namespace std;
+
+int LoadPipeline::threadCount = 1;
+
+LoadPipeline::LoadPipeline()
+{
+  fp = NULL;
+  map = NULL;
+  mapSize = offset = 0;
+  eof = true;
+  error = 0;
+  readSeq = nextSeq = 0;
+  window = 0;
+  stopping = false;
+  pthread_mutex_init(&latch, NULL);
+  pthread_cond_init(&parsed, NULL);
+  pthread_cond_init(&consumed, NULL);
+}
+
+LoadPipeline::~LoadPipeline()
+{
+  close();
+  pthread_cond_destroy(&consumed);
+  pthread_cond_destroy(&parsed);
+  pthread_mutex_destroy(&latch);
+}
+
+RC LoadPipeline::setThreads(int n)
+{
+  if (n < 1 || n > MAX_THREADS) return RC_INVALID_ATTRIBUTE;
+  threadCount = n;
+  return 0;
+}
+
+RC LoadPipeline::open(const string& loadfile)
+{
+  struct stat st;
+  int fd;
+
+  close();
+  if ((fd = ::open(loadfile.c_str(), O_RDONLY)) < 0) return RC_FILE_OPEN_FAILED;
+
+  // map a regular file. anything else is read with stdio
+  bool regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+  if (regular && st.st_size > 0) {
+    void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED) {
+      madvise(p, st.st_size, MADV_SEQUENTIAL);
+      map = (const char*)p;
+      mapSize = st.st_size;
+    }
+  }
+  if (map != NULL || (regular && st.st_size == 0)) {
+    ::close(fd);
+  } else if ((fp = fdopen(fd, "r")) == NULL) {
+    ::close(fd);
+    return RC_FILE_OPEN_FAILED;
+  }
+
+  carry.clear();
+  offset = 0;
+  eof = (map == NULL && fp == NULL);  // an empty file
+  error = 0;
+  readSeq = nextSeq = 0;
+  stopping = false;
+
+  // each thread may have a chunk in hand and one parsed ahead
+  window = 2 * threadCount;
+
+  // with one thread, next() parses the chunks itself
+  if (threadCount > 1) {
+    threads.resize(threadCount);
+    for (int i = 0; i < threadCount; i++) {
+      if (pthread_create(&threads[i], NULL, work, this) != 0) {
+        threads.resize(i);
+        break;
+      }
+    }
+  }
+  return 0;
+}
+
+void LoadPipeline::close()
+{
+  pthread_mutex_lock(&latch);
+  stopping = true;
+  pthread_cond_broadcast(&consumed);
+  pthread_mutex_unlock(&latch);
+
+  for (unsigned i = 0; i < threads.size(); i++) pthread_join(threads[i], NULL);
+  threads.clear();
+
+  for (std::map<long, Batch*>::iterator it = done.begin(); it != done.end(); ++it) delete it->second;
+  done.clear();
+  for (unsigned i = 0; i < spare.size(); i++) delete spare[i];
+  spare.clear();
+
+  if (map != NULL) munmap((void*)map, mapSize);
+  map = NULL;
+  mapSize = 0;
+  if (fp != NULL) fclose(fp);
+  fp = NULL;
+  eof = true;
+}
+
+LoadPipeline::Batch* LoadPipeline::newBatch()
+{
+  if (spare.empty()) return new Batch;
+  Batch* batch = spare.back();
+  spare.pop_back();
+  return batch;
+}
+
+bool LoadPipeline::readChunk(Batch& batch, long& seq)
+{
+  if (eof) return false;
+
+  if (map != NULL) {
+    // the chunk ends with the first line that reaches CHUNK_SIZE bytes
+    const char* begin = map + offset;
+    const char* end = map + mapSize;
+    if (mapSize - offset > (size_t)CHUNK_SIZE) {
+      const char* nl = (const char*)memchr(begin + CHUNK_SIZE, '\n', end - begin - CHUNK_SIZE);
+      if (nl != NULL) end = nl + 1;
+    }
+    batch.begin = begin;
+    batch.end = end;
+    offset = end - map;
+    if (offset == mapSize) eof = true;
+    seq = readSeq++;
+    return true;
+  }
+
+  // the chunk starts with the end of the last line of the previous one
+  // and ends with the last complete line read. a line longer than a
+  // chunk makes the chunk longer
+  string& text = batch.text;
+  text.swap(carry);
+  carry.clear();
+  for (;;) {
+    size_t start = text.size();
+    text.resize(start + CHUNK_SIZE);
+    size_t n = fread(&text[start], 1, CHUNK_SIZE, fp);
+    text.resize(start + n);
+    if (n < (size_t)CHUNK_SIZE) {
+      eof = true;
+      if (ferror(fp)) {
+        error = RC_FILE_READ_FAILED;
+        return false;
+      }
+      break;
+    }
+    string::size_type end = text.rfind('\n');
+    if (end != string::npos) {
+      carry.assign(text, end + 1, string::npos);
+      text.resize(end + 1);
+      break;
+    }
+  }
+
+  if (text.empty()) return false;
+  batch.begin = text.data();
+  batch.end = text.data() + text.size();
+  seq = readSeq++;
+  return true;
+}
+
+RC LoadPipeline::parseLine(const char* s, const char* end, int& key, const char*& value, int& length)
+{
+  // a NUL ends the line
+  const char* nul = (const char*)memchr(s, 0, end - s);
+  if (nul != NULL) end = nul;
+
+  // ignore beginning white spaces
+  while (s < end && (*s == ' ' || *s == '\t')) s++;
+
+  // get the integer key value. as atoi(), a value out of the range of
+  // long is clamped, and the long is cast to int
+  const char* p = s;
+  while (p < end && (*p == ' ' || (*p >= '\t' && *p <= '\r'))) p++;
+  bool neg = false;
+  if (p < end && (*p == '-' || *p == '+')) neg = (*p++ == '-');
+  unsigned long limit = neg ? (unsigned long)LONG_MAX + 1 : (unsigned long)LONG_MAX;
+  unsigned long v = 0;
+  bool over = false;
+  for (; p < end && *p >= '0' && *p <= '9'; p++) {
+    unsigned d = *p - '0';
+    if (over || v > (limit - d) / 10) over = true;
+    else v = v * 10 + d;
+  }
+  if (over) v = limit;
+  key = (int)(neg ? (long)(0UL - v) : (long)v);
+
+  // look for comma
+  s = (const char*)memchr(s, ',', end - s);
+  if (s == NULL) return RC_INVALID_FILE_FORMAT;
+
+  // ignore white spaces
+  do { s++; } while (s < end && (*s == ' ' || *s == '\t'));
+
+  // is the value field delimited by ' or "?
+  const char* stop = end;
+  if (s < end && (*s == '\'' || *s == '"')) {
+    char c = *s++;
+    stop = (const char*)memchr(s, c, end - s);
+    if (stop == NULL) stop = end;
+  }
+
+  value = s;
+  length = stop - s;
+  return 0;
+}
+
+void LoadPipeline::parse(Batch& batch)
+{
+  const char* value;
+  int   key, length;
+
+  batch.keys.clear();
+  batch.values.clear();
+  batch.lengths.clear();
+  batch.hashes.clear();
+
+  const char* s = batch.begin;
+  while (s < batch.end) {
+    const char* end = (const char*)memchr(s, '\n', batch.end - s);
+    if (end == NULL) end = batch.end;
+
+    // skip lines that are not in the "key, value" format
+    if (parseLine(s, end, key, value, length) == 0) {
+      batch.keys.push_back(key);
+      batch.values.push_back(value);
+      batch.lengths.push_back(length);
+      batch.hashes.push_back(TableStats::hash(value, length));
+    }
+    s = end + 1;
+  }
+}
+
+void* LoadPipeline::work(void* arg)
+{
+  ((LoadPipeline*)arg)->work();
+  return NULL;
+}
+
+void LoadPipeline::work()
+{
+  long seq;
+
+  for (;;) {
+    // the file is read by one thread at a time, and no further ahead
+    // of next() than the window allows
+    pthread_mutex_lock(&latch);
+    while (!stopping && !eof && readSeq - nextSeq >= window) {
+      pthread_cond_wait(&consumed, &latch);
+    }
+    Batch* batch = newBatch();
+    bool ok = !stopping && readChunk(*batch, seq);
+    if (!ok) {
+      spare.push_back(batch);
+      pthread_cond_broadcast(&parsed);
+      pthread_mutex_unlock(&latch);
+      return;
+    }
+    pthread_mutex_unlock(&latch);
+
+    parse(*batch);
+
+    pthread_mutex_lock(&latch);
+    done[seq] = batch;
+    pthread_cond_broadcast(&parsed);
+    pthread_mutex_unlock(&latch);
+  }
+}
+
+RC LoadPipeline::next(Batch*& batch)
+{
+  long seq;
+
+  pthread_mutex_lock(&latch);
+  while (done.find(nextSeq) == done.end()) {
+    // every chunk read was returned
+    if (eof && readSeq == nextSeq) {
+      RC rc = (error < 0) ? error : RC_END_OF_INPUT;
+      pthread_mutex_unlock(&latch);
+      return rc;
+    }
+
+    if (!threads.empty()) {
+      pthread_cond_wait(&parsed, &latch);
+    } else {
+      Batch* b = newBatch();
+      if (readChunk(*b, seq)) {
+        parse(*b);
+        done[seq] = b;
+      } else {
+        spare.push_back(b);
+      }
+    }
+  }
+
+  batch = done[nextSeq];
+  done.erase(nextSeq);
+  nextSeq++;
+  pthread_cond_broadcast(&consumed);
+  pthread_mutex_unlock(&latch);
+
+  return 0;
+}
+
+void LoadPipeline::release(Batch* batch)
+{
+  pthread_mutex_lock(&latch);
+  spare.push_back(batch);
+  pthread_mutex_unlock(&latch);
+}
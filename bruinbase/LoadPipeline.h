@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef LOADPIPELINE_H
+#define LOADPIPELINE_H
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include "Bruinbase.h"
+
+/**
+ * Reads and parses a load file with several threads.
+ * The file is memory-mapped and cut into chunks of about CHUNK_SIZE
+ * bytes that end at a line boundary. Each parser thread takes the next
+ * chunk and parses its lines in place: a value is returned as a pointer
+ * into the mapping and a length, so nothing is copied or allocated per
+ * line. The batches are returned by next() in the order of the file, so
+ * the single thread that appends them to the table sees the tuples in
+ * the same order as a sequential load would.
+ * A file that cannot be mapped, such as a pipe, is read into a buffer
+ * per chunk instead. With one thread, the chunks are parsed by the
+ * caller of next().
+ */
+class LoadPipeline {
+ public:
+  static const int CHUNK_SIZE = 1 << 20;  // bytes of the file per batch
+  static const int MAX_THREADS = 64;
+
+  /**
+   * the tuples parsed from one chunk. values[i] is not NUL-terminated;
+   * it has lengths[i] bytes. hashes[i] is its TableStats::hash(), so
+   * that the thread appending the tuples does not compute it.
+   */
+  struct Batch {
+    std::vector<int> keys;
+    std::vector<const char*> values;
+    std::vector<int> lengths;
+    std::vector<unsigned long long> hashes;
+
+    const char* begin;   // the chunk
+    const char* end;
+    std::string text;    // the chunk, if the file is not mapped
+  };
+
+  LoadPipeline();
+  ~LoadPipeline();
+
+  /**
+   * open a load file and start the parser threads.
+   * @param loadfile[IN] the name of the load file
+   * @return error code. 0 if no error
+   */
+  RC open(const std::string& loadfile);
+
+  /**
+   * get the tuples of the next chunk of the file. the batch and the
+   * values it points to belong to the caller until it is handed to
+   * release().
+   * @param batch[OUT] the tuples of the chunk
+   * @return error code. RC_END_OF_INPUT after the last chunk
+   */
+  RC next(Batch*& batch);
+
+  /**
+   * give back a batch returned by next(). it is used again for a later
+   * chunk.
+   * @param batch[IN] the batch
+   */
+  void release(Batch* batch);
+
+  /**
+   * stop the parser threads and close the file.
+   */
+  void close();
+
+  /**
+   * parse a line of a load file without copying it. this function
+   * defines the format of a load file: each line holds a tuple as
+   * "key, value". white space before the key and after the comma is
+   * skipped. the key is read like atoi(): an optional sign and the
+   * digits that follow, 0 if there are none, clamped to the range of
+   * long and cast to int. a value that starts with ' or " ends before
+   * the next quote of the same kind, or at the end of the line if there
+   * is none. any other value runs to the end of the line. a NUL byte
+   * ends the line. a line without a comma is not a tuple.
+   * @param s[IN] the line
+   * @param end[IN] the end of the line
+   * @param key[OUT] the key field of the tuple in the line
+   * @param value[OUT] the value field, pointing into the line
+   * @param length[OUT] the length of the value field
+   * @return error code. 0 if no error
+   */
+  static RC parseLine(const char* s, const char* end, int& key, const char*& value, int& length);
+
+  /**
+   * set the number of parser threads of the loads from now on.
+   * @param n[IN] 1 to MAX_THREADS
+   * @return error code. 0 if no error
+   */
+  static RC setThreads(int n);
+
+ private:
+  LoadPipeline(const LoadPipeline&);
+  LoadPipeline& operator=(const LoadPipeline&);
+
+  // take the next chunk of the file into batch. the latch must be held.
+  // returns false at the end of the file or on an error
+  bool readChunk(Batch& batch, long& seq);
+
+  // take a batch from the free list, or a new one. the latch must be held
+  Batch* newBatch();
+
+  // parse the lines of the chunk of a batch
+  static void parse(Batch& batch);
+
+  // the body of a parser thread
+  static void* work(void* arg);
+  void work();
+
+  FILE*  fp;            // the load file, if it is not mapped
+  std::string carry;    // the part of the last line of the previous chunk
+  const char* map;      // the mapped load file. NULL if not mapped
+  size_t mapSize;
+  size_t offset;        // the start of the next chunk in the mapping
+  bool   eof;           // the whole file was read
+  RC     error;         // the first read error
+
+  long   readSeq;       // the number of the next chunk to read
+  long   nextSeq;       // the number of the next chunk next() returns
+  std::map<long, Batch*> done;  // parsed chunks not returned yet
+  std::vector<Batch*> spare;    // released batches
+  int    window;        // chunks that may be read ahead of next()
+  bool   stopping;      // close() was called
+
+  std::vector<pthread_t> threads;
+  pthread_mutex_t latch;
+  pthread_cond_t  parsed;   // a chunk was parsed
+  pthread_cond_t  consumed; // next() took a chunk
+
+  static int threadCount;   // parser threads of a load
+};
+
+#endif // LOADPIPELINE_H
@@ -7,31 +7,115 @@
  * @date 3/24/2008
  */
 
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
 #include "Bruinbase.h"
 #include "PageFile.h"
+#include "BufferPool.h"
+#include "IoRing.h"
+#include <cerrno>
 #include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <vector>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 
 using std::string;
 
 int PageFile::readCount = 0;
 int PageFile::writeCount = 0;
-int PageFile::cacheClock = 1;
-struct PageFile::cacheStruct PageFile::readCache[PageFile::CACHE_COUNT];
+int PageFile::prefetchCount = 0;
+bool PageFile::writeBack = true;
+bool PageFile::memoryMap = false;
+bool PageFile::directIO = false;
+bool PageFile::asyncIO = false;
+
+// read n bytes at offset. a short read is continued until the end of
+// the file. returns the number of bytes read, or -1 on error
+static ssize_t readFully(int fd, void* buf, size_t n, off_t offset)
+{
+  size_t done = 0;
+  while (done < n) {
+    ssize_t r = ::pread(fd, (char*)buf + done, n - done, offset + done);
+    if (r < 0 && errno == EINTR) continue;
+    if (r < 0) return -1;
+    if (r == 0) break;
+    done += r;
+  }
+  return done;
+}
+
+// write n bytes at offset, continuing short writes.
+// returns false on error
+static bool writeFully(int fd, const void* buf, size_t n, off_t offset)
+{
+  size_t done = 0;
+  while (done < n) {
+    ssize_t w = ::pwrite(fd, (const char*)buf + done, n - done, offset + done);
+    if (w < 0 && errno == EINTR) continue;
+    if (w <= 0) return false;
+    done += w;
+  }
+  return true;
+}
+int PageFile::defaultPageSize = PageFile::LEGACY_PAGE_SIZE;
 
 PageFile::PageFile() 
 { 
   fd = -1; 
+  directFd = -1;
+  directAlign = 0;
+  directReads = false;
+  directFailed = false;
+  bounce = NULL;
+  pthread_mutex_init(&bounceLatch, NULL);
   epid = 0; 
+  pageSize = defaultPageSize;
+  dataOffset = 0;
+  format = 0;
+  map.addr = NULL;
+  map.size = 0;
+  access = NORMAL;
 }
 
 PageFile::PageFile(const string& filename, char mode)
 {
   fd = -1;
+  directFd = -1;
+  directAlign = 0;
+  directReads = false;
+  directFailed = false;
+  bounce = NULL;
+  pthread_mutex_init(&bounceLatch, NULL);
   epid = 0;
+  pageSize = defaultPageSize;
+  dataOffset = 0;
+  format = 0;
+  map.addr = NULL;
+  map.size = 0;
+  access = NORMAL;
   open(filename.c_str(), mode);
 }
 
+PageFile::~PageFile()
+{
+  free(bounce);
+  pthread_mutex_destroy(&bounceLatch);
+}
+
+RC PageFile::setDefaultPageSize(int size)
+{
+  // the page size must be a power of 2 in the supported range
+  if (size < MIN_PAGE_SIZE || size > MAX_PAGE_SIZE || (size & (size - 1))) {
+    return RC_INVALID_ATTRIBUTE;
+  }
+  defaultPageSize = size;
+  return 0;
+}
+
 RC PageFile::open(const string& filename, char mode)
 {
   RC   rc;
@@ -58,121 +142,542 @@ RC PageFile::open(const string& filename, char mode)
   fd = ::open(filename.c_str(), oflag, 0644);
   if (fd < 0) { fd = -1; return RC_FILE_OPEN_FAILED; }
 
-  // get the size of the file to set the end pid
+  // get the size of the file to find the page size and the end pid
   rc = ::fstat(fd, &statbuf);
   if (rc < 0) { ::close(fd); fd = -1; return RC_FILE_OPEN_FAILED; }
-  epid = statbuf.st_size / PAGE_SIZE;
+  if ((rc = setupHeader(statbuf.st_size)) < 0) { ::close(fd); fd = -1; return rc; }
+  epid = (statbuf.st_size - dataOffset) / pageSize;
+  if (epid < 0) epid = 0;
+
+  // a file that cannot be mapped is read through the buffer pool
+  access = NORMAL;
+  directReads = false;
+  if (memoryMap && oflag == O_RDONLY && epid > 0) remap();
+
+  // the O_DIRECT descriptor is used by scans
+  if (directIO && oflag == O_RDONLY && map.addr == NULL) openDirect(filename);
+
+  return 0;
+}
+
+void PageFile::openDirect(const string& filename)
+{
+  // not every file system supports O_DIRECT
+  directFailed = false;
+  directFd = ::open(filename.c_str(), O_RDONLY | O_DIRECT);
+  if (directFd < 0) {
+    directFd = -1;
+    return;
+  }
+
+  // the offsets, the sizes and the buffers of the reads must be aligned
+  // to the block size of the device. older kernels do not report it
+  directAlign = DIRECT_ALIGN;
+#ifdef STATX_DIOALIGN
+  struct statx stx;
+  if (::statx(directFd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &stx) == 0 &&
+      (stx.stx_mask & STATX_DIOALIGN) && stx.stx_dio_offset_align > 0) {
+    directAlign = stx.stx_dio_offset_align;
+    if ((int)stx.stx_dio_mem_align > directAlign) directAlign = stx.stx_dio_mem_align;
+  }
+#endif
+
+  // a page that does not start on a block boundary cannot be read with
+  // O_DIRECT, so the file is read through the page cache
+  if (pageSize % directAlign != 0 || dataOffset % directAlign != 0 ||
+      ::posix_memalign((void**)&bounce, directAlign, pageSize) != 0) {
+    bounce = NULL;
+    ::close(directFd);
+    directFd = -1;
+  }
+}
+
+RC PageFile::setupHeader(off_t size)
+{
+  Header header;
+
+  // a new file gets a header with the default page size.
+  // (an empty file opened for reading has no pages to worry about.)
+  if (size == 0) {
+    pageSize = defaultPageSize;
+    dataOffset = pageSize;
+
+    char* block = new char[pageSize];
+    memset(block, 0, pageSize);
+    header.magic = HEADER_MAGIC;
+    header.version = HEADER_VERSION;
+    header.pageSize = pageSize;
+    header.format = format = 0;
+    memcpy(block, &header, sizeof(Header));
+    bool ok = writeFully(fd, block, pageSize, 0);
+    delete [] block;
 
+    // a read-only file cannot be given a header
+    if (!ok && errno == EBADF) return 0;
+    return ok ? 0 : RC_FILE_WRITE_FAILED;
+  }
+
+  // a file without the header is an old file with 1KB pages
+  if (readFully(fd, &header, sizeof(Header), 0) != (ssize_t)sizeof(Header) ||
+      header.magic != HEADER_MAGIC) {
+    pageSize = LEGACY_PAGE_SIZE;
+    dataOffset = 0;
+    format = 0;
+    return 0;
+  }
+
+  if (header.version != HEADER_VERSION || header.pageSize < MIN_PAGE_SIZE ||
+      header.pageSize > MAX_PAGE_SIZE) {
+    return RC_INVALID_FILE_FORMAT;
+  }
+  pageSize = header.pageSize;
+  dataOffset = pageSize;
+  format = header.format;
+  return 0;
+}
+
+RC PageFile::setFormat(int f)
+{
+  if (f == format) return 0;
+  if (fd < 0 || dataOffset == 0) return RC_INVALID_FILE_FORMAT;
+
+  if (!writeFully(fd, &f, sizeof(int), offsetof(Header, format))) return RC_FILE_WRITE_FAILED;
+  format = f;
   return 0;
 }
 
 RC PageFile::close()
 {
+  RC rc;
   if (fd <= 0) return RC_FILE_CLOSE_FAILED;
 
-  // close the file
-  if (::close(fd) < 0) return RC_FILE_CLOSE_FAILED;
-
-  // evict all cached pages for this file
-  for (int i = 0; i < CACHE_COUNT; i++) {
-    if (readCache[i].fd == fd && readCache[i].lastAccessed != 0) {
-       readCache[i].fd = 0;
-       readCache[i].pid = 0;
-       readCache[i].lastAccessed = 0;
-    }
+  // write the dirty pages and evict all cached pages for this file
+  rc = flush();
+  BufferPool::instance().discard(fd);
+
+  // unmap the file
+  if (map.addr != NULL) {
+    retired.push_back(map);
+    for (unsigned i = 0; i < retired.size(); i++) ::munmap(retired[i].addr, retired[i].size);
+    retired.clear();
+    touched.clear();
+    map.addr = NULL;
+    map.size = 0;
   }
 
+  // close the file
+  if (directFd >= 0) ::close(directFd);
+  directFd = -1;
+  directAlign = 0;
+  directReads = false;
+  free(bounce);
+  bounce = NULL;
+  if (::close(fd) < 0) rc = RC_FILE_CLOSE_FAILED;
+  if (rc < 0) { fd = -1; epid = 0; return rc; }
+
   // set the fd and epid to the initial state
   fd = -1; 
   epid = 0;
   return 0;
 }
 
+PageGuard::PageGuard()
+{
+  page = NULL;
+  pageId = -1;
+  shard = frame = -1;
+}
+
+PageGuard::~PageGuard()
+{
+  release();
+}
+
+void PageGuard::release()
+{
+  if (page == NULL) return;
+  // a page of a mapped file is not pinned in the buffer pool
+  if (shard >= 0) BufferPool::instance().unpin(*this);
+  page = NULL;
+  pageId = -1;
+  shard = frame = -1;
+}
+
 PageId PageFile::endPid() const 
 {
   return epid;
 }
 
-RC PageFile::seek(PageId pid) const
+RC PageFile::flush()
 {
-  return (::lseek(fd, pid * PAGE_SIZE, SEEK_SET) < 0) ? RC_FILE_SEEK_FAILED : 0;
+  if (fd <= 0) return RC_FILE_WRITE_FAILED;
+  return BufferPool::instance().flush(*this, fd);
 }
 
 RC PageFile::write(PageId pid, const void* buffer)
 {
-  RC rc;
   if (pid < 0) return RC_INVALID_PID; 
 
-  // seek to the location of the page
-  if ((rc = seek(pid) < 0)) return rc;
-
-  // write the buffer to the disk page
-  if (::write(fd, buffer, PAGE_SIZE) < 0) return RC_FILE_WRITE_FAILED;
-
-  // if the page is in read cache, invalidate it
-  for (int i = 0; i < CACHE_COUNT; i++) {
-    if (readCache[i].fd == fd && readCache[i].pid == pid &&
-        readCache[i].lastAccessed != 0) {
-       readCache[i].fd = 0;
-       readCache[i].pid = 0;
-       readCache[i].lastAccessed = 0;
-       break;
+  // in write-back mode, keep the page dirty in the buffer pool.
+  // if the pool has no frame to spare, write the page through.
+  if (writeBack) {
+    bool crowded = false;
+    if (BufferPool::instance().install(*this, fd, pid, buffer, crowded) == 0) {
+      if (pid >= epid) epid = pid + 1;
+      // flush early when dirty pages crowd out the rest of the cache
+      return crowded ? flush() : 0;
     }
   }
 
+  // write the buffer to the disk page
+  if (!writeFully(fd, buffer, pageSize, offsetOf(pid))) return RC_FILE_WRITE_FAILED;
+
+  // if the page is in the buffer pool, keep the cached copy current
+  BufferPool::instance().update(fd, pid, buffer);
+
   // if the written pid >= end pid, update the end pid
   if (pid >= epid) epid = pid + 1;
 
   // increase page write count
-  writeCount++;
+  __sync_fetch_and_add(&writeCount, 1);
 
   return 0;
 }
 
 RC PageFile::read(PageId pid, void* buffer) const
 {
-  RC rc;
+  // a mapped file may have grown since it was mapped
+  if (map.addr != NULL && pid >= epid) remap();
+  if (pid < 0 || pid >= epid) return RC_INVALID_PID; 
 
+  if (map.addr != NULL) {
+    memcpy(buffer, mappedPage(pid), pageSize);
+    return 0;
+  }
+
+  // the buffer pool reads the page through readPage() if it is not cached
+  return BufferPool::instance().read(*this, fd, pid, buffer);
+}
+
+RC PageFile::fetch(PageId pid, PageGuard& page) const
+{
+  page.release();
+  if (map.addr != NULL && pid >= epid) remap();
   if (pid < 0 || pid >= epid) return RC_INVALID_PID; 
 
-  //
-  // if the page is in cache, read it from there
-  //
-  for (int i = 0; i < CACHE_COUNT; i++) {
-    if (readCache[i].fd == fd && readCache[i].pid == pid && 
-        readCache[i].lastAccessed != 0) {
-       memcpy(buffer, readCache[i].buffer, PAGE_SIZE);
-       readCache[i].lastAccessed = ++cacheClock;
-       return 0;
-    }
+  // the handle points straight into the mapping
+  if (map.addr != NULL) {
+    page.page = mappedPage(pid);
+    page.pageId = pid;
+    return 0;
   }
 
-  // seek to the page
-  if ((rc = seek(pid) < 0)) return rc;
-  
-  // find the cache slot to evict
-  int toEvict = 0; 
-  for (int i = 0; i < CACHE_COUNT; i++) {
-    if (readCache[i].lastAccessed == 0) {
-      toEvict = i;
-      break;
-    }
-    if (readCache[i].lastAccessed < readCache[toEvict].lastAccessed) {
-      toEvict = i;
+  return BufferPool::instance().pin(*this, fd, pid, page);
+}
+
+RC PageFile::prefetch(PageId pid, int count) const
+{
+  if (pid < 0 || pid >= epid) return RC_INVALID_PID;
+  if (pid + count > epid) count = epid - pid;
+  if (count <= 0) return 0;
+
+  if (asyncIO && map.addr == NULL && IoRing::instance() != NULL) {
+    std::vector<PageId> pids(count);
+    for (int i = 0; i < count; i++) pids[i] = pid + i;
+    return prefetch(&pids[0], count);
+  }
+  return adviseWillNeed(pid, count);
+}
+
+RC PageFile::prefetch(const PageId* pids, int count) const
+{
+  RC rc;
+
+  for (int i = 0; i < count; i++) {
+    if (pids[i] < 0 || pids[i] >= epid) return RC_INVALID_PID;
+  }
+
+  // the buffer pool reads the pages it does not hold in one batch
+  if (asyncIO && map.addr == NULL && IoRing::instance() != NULL) {
+    if ((rc = BufferPool::instance().load(*this, fd, pids, count)) < 0) return rc;
+    __sync_fetch_and_add(&prefetchCount, count);
+    return 0;
+  }
+
+  int first = 0;
+  for (int i = 1; i <= count; i++) {
+    if (i < count && pids[i] == pids[i-1] + 1) continue;
+    if ((rc = adviseWillNeed(pids[first], i - first)) < 0) return rc;
+    first = i;
+  }
+  return 0;
+}
+
+RC PageFile::adviseWillNeed(PageId pid, int count) const
+{
+  // the kernel starts reading the pages into its cache and returns.
+  // madvise() needs an address aligned to a memory page
+  if (map.addr != NULL) {
+    off_t start = offsetOf(pid);
+    off_t align = start % sysconf(_SC_PAGESIZE);
+    if (::madvise(map.addr + start - align, (size_t)count * pageSize + align, MADV_WILLNEED) != 0) {
+      return RC_FILE_READ_FAILED;
     }
+  } else if (::posix_fadvise(fd, offsetOf(pid), (off_t)count * pageSize,
+                             POSIX_FADV_WILLNEED) != 0) {
+    return RC_FILE_READ_FAILED;
+  }
+  __sync_fetch_and_add(&prefetchCount, count);
+
+  return 0;
+}
+
+RC PageFile::advise(Access pattern) const
+{
+  static const int madvice[] = { MADV_NORMAL, MADV_SEQUENTIAL, MADV_RANDOM };
+  static const int fadvice[] = { POSIX_FADV_NORMAL, POSIX_FADV_SEQUENTIAL, POSIX_FADV_RANDOM };
+
+  if (fd <= 0) return RC_FILE_READ_FAILED;
+
+  // the hint is given again when the file is mapped again.
+  // a scan reads with O_DIRECT if it is available
+  access = pattern;
+  directReads = (pattern == SEQUENTIAL && canReadDirect());
+  if (map.addr != NULL) {
+    if (::madvise(map.addr, map.size, madvice[pattern]) != 0) return RC_FILE_READ_FAILED;
+  } else if (::posix_fadvise(fd, 0, 0, fadvice[pattern]) != 0) {
+    return RC_FILE_READ_FAILED;
+  }
+  return 0;
+}
+
+RC PageFile::remap() const
+{
+  struct stat statbuf;
+
+  if (::fstat(fd, &statbuf) < 0) return RC_FILE_READ_FAILED;
+  if ((size_t)statbuf.st_size <= map.size) return 0;
+
+  void* addr = ::mmap(NULL, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED) return RC_FILE_READ_FAILED;
+
+  if (map.addr != NULL) retired.push_back(map);
+  map.addr = (char*)addr;
+  map.size = statbuf.st_size;
+  if (access != NORMAL) advise(access);
+
+  epid = (statbuf.st_size - dataOffset) / pageSize;
+  touched.resize(epid, 0);
+  return 0;
+}
+
+char* PageFile::mappedPage(PageId pid) const
+{
+  // the first touch of a page is what reads it from the disk
+  if (!touched[pid]) {
+    touched[pid] = 1;
+    __sync_fetch_and_add(&readCount, 1);
   }
-  readCache[toEvict].fd = fd;
-  readCache[toEvict].pid = pid;
-  readCache[toEvict].lastAccessed = ++cacheClock;
- 
-  // read the page to cache first and copy it to the buffer
-  if (::read(fd, readCache[toEvict].buffer, PAGE_SIZE) < 0) {
+  return map.addr + dataOffset + (off_t)pid * pageSize;
+}
+
+RC PageFile::readPage(PageId pid, void* buffer) const
+{
+  // the file is aligned for O_DIRECT, so a failure is not expected. if
+  // the file system refuses O_DIRECT only when it is used, the file is
+  // read through the page cache from now on, and canReadDirect() says so
+  if (directReads) {
+    if (readDirect(pid, buffer) == 0) return 0;
+    directReads = false;
+    directFailed = true;
+  }
+
+  ssize_t n = readFully(fd, buffer, pageSize, offsetOf(pid));
+  if (n < 0) {
     return RC_FILE_READ_FAILED;
   }
-  memcpy(buffer, readCache[toEvict].buffer, PAGE_SIZE);
+  // a page that was never written back reads as zeros
+  if (n < pageSize) memset((char*)buffer + n, 0, pageSize - n);
 
   // increase the page read count
-  readCount++;
+  __sync_fetch_and_add(&readCount, 1);
+
+  return 0;
+}
+
+RC PageFile::readDirect(PageId pid, void* buffer) const
+{
+  ssize_t n;
+
+  // O_DIRECT moves the page straight to the buffer if it is aligned, as
+  // the frames of the buffer pool are. otherwise the page goes through
+  // the bounce buffer of the file
+  if ((size_t)buffer % directAlign == 0) {
+    n = readFully(directFd, buffer, pageSize, offsetOf(pid));
+  } else {
+    pthread_mutex_lock(&bounceLatch);
+    n = readFully(directFd, bounce, pageSize, offsetOf(pid));
+    if (n > 0) memcpy(buffer, bounce, n);
+    pthread_mutex_unlock(&bounceLatch);
+  }
+  if (n < 0) return RC_FILE_READ_FAILED;
+
+  if (n < pageSize) memset((char*)buffer + n, 0, pageSize - n);
+  __sync_fetch_and_add(&readCount, 1);
+
+  return 0;
+}
+
+RC PageFile::writePages(PageId pid, char* const* pages, int count)
+{
+  struct iovec iov[IOV_MAX];
+
+  // write the run with as few system calls as possible
+  while (count > 0) {
+    int n = (count < IOV_MAX) ? count : IOV_MAX;
+    for (int i = 0; i < n; i++) {
+      iov[i].iov_base = pages[i];
+      iov[i].iov_len = pageSize;
+    }
+    ssize_t w;
+    do {
+      w = ::pwritev(fd, iov, n, offsetOf(pid));
+    } while (w < 0 && errno == EINTR);
+    if (w < 0) return RC_FILE_WRITE_FAILED;
+
+    // finish a short write page by page
+    for (int i = w / pageSize; i < n; i++) {
+      int done = (i == w / pageSize) ? w % pageSize : 0;
+      if (!writeFully(fd, pages[i] + done, pageSize - done, offsetOf(pid + i) + done)) {
+        return RC_FILE_WRITE_FAILED;
+      }
+    }
+    __sync_fetch_and_add(&writeCount, n);
+
+    pid += n;
+    pages += n;
+    count -= n;
+  }
+  return 0;
+}
+
+// the runs of adjacent pages in pids, each at most IOV_MAX pages long.
+// run i covers the pages runs[i] to runs[i+1]-1 of pids
+static void findRuns(const PageId* pids, int count, std::vector<int>& runs)
+{
+  runs.clear();
+  for (int i = 0; i < count; i++) {
+    if (i > 0 && pids[i] == pids[i-1] + 1 && i - runs.back() < IOV_MAX) continue;
+    runs.push_back(i);
+  }
+  runs.push_back(count);
+}
+
+RC PageFile::readBatch(const PageId* pids, char* const* buffers, int count) const
+{
+  IoRing* ring = asyncIO ? IoRing::instance() : NULL;
+  std::vector<int> runs;
+
+  if (count <= 0) return 0;
+  for (int i = 0; i < count; i++) {
+    if (pids[i] < 0) return RC_INVALID_PID;
+  }
+
+  // without io_uring, the pages are read one by one
+  if (ring == NULL) {
+    for (int i = 0; i < count; i++) {
+      ssize_t n = readFully(fd, buffers[i], pageSize, offsetOf(pids[i]));
+      if (n < 0) return RC_FILE_READ_FAILED;
+      if (n < pageSize) memset(buffers[i] + n, 0, pageSize - n);
+    }
+    __sync_fetch_and_add(&readCount, count);
+    return 0;
+  }
+
+  findRuns(pids, count, runs);
+  int nruns = runs.size() - 1;
+  std::vector<struct iovec> iov(count);
+  std::vector<IoRing::Request> reqs(nruns);
+  for (int i = 0; i < count; i++) {
+    iov[i].iov_base = buffers[i];
+    iov[i].iov_len = pageSize;
+  }
+  for (int r = 0; r < nruns; r++) {
+    reqs[r].fd = fd;
+    reqs[r].offset = offsetOf(pids[runs[r]]);
+    reqs[r].iov = &iov[runs[r]];
+    reqs[r].iovcnt = runs[r+1] - runs[r];
+    reqs[r].write = false;
+  }
+  ring->run(&reqs[0], nruns);
+
+  // a short read is finished like in readPage(). past the end of the
+  // file, a page reads as zeros
+  for (int r = 0; r < nruns; r++) {
+    if (reqs[r].result < 0) return RC_FILE_READ_FAILED;
+    for (int i = runs[r]; i < runs[r+1]; i++) {
+      ssize_t done = reqs[r].result - (ssize_t)(i - runs[r]) * pageSize;
+      if (done >= pageSize) continue;
+      if (done < 0) done = 0;
+      ssize_t n = readFully(fd, buffers[i] + done, pageSize - done, offsetOf(pids[i]) + done);
+      if (n < 0) return RC_FILE_READ_FAILED;
+      if (done + n < pageSize) memset(buffers[i] + done + n, 0, pageSize - done - n);
+    }
+  }
+  __sync_fetch_and_add(&readCount, count);
+
+  return 0;
+}
+
+RC PageFile::writeBatch(const PageId* pids, char* const* buffers, int count)
+{
+  RC rc;
+  IoRing* ring = asyncIO ? IoRing::instance() : NULL;
+  std::vector<int> runs;
+
+  if (count <= 0) return 0;
+  for (int i = 0; i < count; i++) {
+    if (pids[i] < 0) return RC_INVALID_PID;
+  }
+  findRuns(pids, count, runs);
+  int nruns = runs.size() - 1;
+
+  // without io_uring, every run is written with one system call
+  if (ring == NULL) {
+    for (int r = 0; r < nruns; r++) {
+      if ((rc = writePages(pids[runs[r]], buffers + runs[r], runs[r+1] - runs[r])) < 0) return rc;
+    }
+    return 0;
+  }
+
+  std::vector<struct iovec> iov(count);
+  std::vector<IoRing::Request> reqs(nruns);
+  for (int i = 0; i < count; i++) {
+    iov[i].iov_base = buffers[i];
+    iov[i].iov_len = pageSize;
+  }
+  for (int r = 0; r < nruns; r++) {
+    reqs[r].fd = fd;
+    reqs[r].offset = offsetOf(pids[runs[r]]);
+    reqs[r].iov = &iov[runs[r]];
+    reqs[r].iovcnt = runs[r+1] - runs[r];
+    reqs[r].write = true;
+  }
+  ring->run(&reqs[0], nruns);
+
+  // finish a short write page by page
+  for (int r = 0; r < nruns; r++) {
+    if (reqs[r].result < 0) return RC_FILE_WRITE_FAILED;
+    for (int i = runs[r]; i < runs[r+1]; i++) {
+      ssize_t done = reqs[r].result - (ssize_t)(i - runs[r]) * pageSize;
+      if (done >= pageSize) continue;
+      if (done < 0) done = 0;
+      if (!writeFully(fd, buffers[i] + done, pageSize - done, offsetOf(pids[i]) + done)) {
+        return RC_FILE_WRITE_FAILED;
+      }
+    }
+  }
+  __sync_fetch_and_add(&writeCount, count);
 
   return 0;
 }
@@ -11,24 +11,90 @@
 #define PAGEFILE_H
 
 #include <string>
+#include <vector>
+#include <sys/types.h>
+#include <pthread.h>
 #include "Bruinbase.h"
 
 typedef int PageId;
 
 /**
- * read/write a file in the unit of a page
+ * a handle to a page pinned in the buffer pool.
+ * data() points straight into the buffer pool frame, so the page can be
+ * read (and modified before PageFile::write()) without copying it.
+ * the page stays pinned, i.e., it cannot be evicted, until release() is
+ * called or the handle is destroyed.
+ */
+class PageGuard {
+ public:
+  PageGuard();
+  ~PageGuard();
+
+  /**
+   * @return pointer to the pinned page. NULL if nothing is pinned
+   */
+  char* data() const { return page; }
+
+  /**
+   * @return the id of the pinned page
+   */
+  PageId pid() const { return pageId; }
+
+  /**
+   * @return true if the handle holds a pinned page
+   */
+  bool isPinned() const { return page != NULL; }
+
+  /**
+   * unpin the page. the pointer returned by data() becomes invalid.
+   */
+  void release();
+
+ private:
+  // a pin cannot be shared, so a handle cannot be copied
+  PageGuard(const PageGuard&);
+  PageGuard& operator=(const PageGuard&);
+
+  friend class BufferPool;
+  friend class PageFile;
+
+  char*  page;    // the frame content
+  PageId pageId;  // the id of the pinned page
+  int    shard;   // location of the frame in the buffer pool.
+  int    frame;   //   -1 for a page of a memory-mapped file
+};
+
+/**
+ * read/write a file in the unit of a page.
+ * the page size of a file is chosen when the file is created and stored
+ * in a header block in front of page 0. files written before the header
+ * was introduced have no header and use LEGACY_PAGE_SIZE.
  */
 class PageFile {
  public:
 
-  static const int PAGE_SIZE = 1024;    // the size of a page is 1KB
+  static const int LEGACY_PAGE_SIZE = 1024;  // page size of header-less files
+  static const int MIN_PAGE_SIZE = 1024;     // the page size is a power of 2
+  static const int MAX_PAGE_SIZE = 65536;    //   between 1KB and 64KB
+  static const int DIRECT_ALIGN = 4096;      // the block size O_DIRECT is
+                                             //   assumed to need if the
+                                             //   kernel does not tell
+
+  /**
+   * the ways a file can be read, hinted with advise()
+   */
+  enum Access { NORMAL, SEQUENTIAL, RANDOM };
 
   PageFile();
   PageFile(const std::string& filename, char mode);
+  ~PageFile();
 
   /**
    * open a file in read or write mode.
-   * when opened in 'w' mode, if the file does not exist, it is created.
+   * when opened in 'w' mode, if the file does not exist, it is created
+   * with the default page size.
+   * when opened in 'r' mode with memory mapping on, the file is mapped
+   * and its pages are read from the mapping instead of the buffer pool.
    * @param filename[IN] the name of the file to open
    * @param mode[IN] 'r' for read, 'w' for write
    * @return error code. 0 if no error
@@ -36,10 +102,18 @@ class PageFile {
   RC open(const std::string& filename, char mode);
 
   /**
-   * close the file.
+   * close the file. the dirty pages of the file are flushed first.
    * @return error code. 0 if no error
    */
   RC close();
+
+  /**
+   * write all dirty pages of the file to the disk (checkpoint).
+   * the pages are written in pid order and adjacent pages are
+   * written with a single system call.
+   * @return error code. 0 if no error
+   */
+  RC flush();
   
   /**
    * read a disk page into memory buffer.
@@ -48,9 +122,73 @@ class PageFile {
    * @return error code. 0 if no error
    */
   RC read(PageId pid, void *buffer) const;
+
+  /**
+   * pin a disk page in the buffer pool without copying it.
+   * any page previously held by the handle is released first.
+   * @param pid[IN] the page to pin
+   * @param page[OUT] the handle to the pinned page
+   * @return error code. 0 if no error
+   */
+  RC fetch(PageId pid, PageGuard& page) const;
+
+  /**
+   * ask the operating system to read count pages starting from pid
+   * in the background, so that a later read() or fetch() of them does
+   * not wait for the disk. this is only a hint; nothing is read into
+   * the buffer pool. with asynchronous I/O on, the pages are instead
+   * read into the buffer pool with one batch of io_uring requests.
+   * @param pid[IN] the first page to read ahead
+   * @param count[IN] the number of pages to read ahead
+   * @return error code. 0 if no error
+   */
+  RC prefetch(PageId pid, int count) const;
+
+  /**
+   * read ahead the pages in pids like prefetch(pid, count).
+   * runs of adjacent pages are asked for together.
+   * @param pids[IN] the pages to read ahead
+   * @param count[IN] the number of pages
+   * @return error code. 0 if no error
+   */
+  RC prefetch(const PageId* pids, int count) const;
+
+  /**
+   * read several disk pages directly, bypassing the buffer pool.
+   * with asynchronous I/O on, the reads are submitted to io_uring
+   * together, and runs of adjacent pages are read with one request.
+   * otherwise, or if io_uring is not available, the pages are read
+   * one after the other.
+   * @param pids[IN] the pages to read
+   * @param buffers[OUT] buffers[i] receives the page pids[i]
+   * @param count[IN] the number of pages
+   * @return error code. 0 if no error
+   */
+  RC readBatch(const PageId* pids, char* const* buffers, int count) const;
+
+  /**
+   * write several disk pages directly, bypassing the buffer pool.
+   * runs of adjacent pages are written with one request, submitted
+   * to io_uring together with asynchronous I/O on.
+   * @param pids[IN] the pages to write
+   * @param buffers[IN] buffers[i] is the content of the page pids[i]
+   * @param count[IN] the number of pages
+   * @return error code. 0 if no error
+   */
+  RC writeBatch(const PageId* pids, char* const* buffers, int count);
+
+  /**
+   * tell the operating system how the file is going to be read, so that
+   * it can adjust its read-ahead. this is only a hint.
+   * @param pattern[IN] SEQUENTIAL for scans, RANDOM for probes
+   * @return error code. 0 if no error
+   */
+  RC advise(Access pattern) const;
   
   /**
    * write the memory buffer to the disk page.
+   * in write-back mode, the page is only copied to the buffer pool and
+   * reaches the disk on flush(), on close(), or when its frame is needed.
    * if (pid >= endPid()), the file is expanded such that
    * endPid() becomes (pid + 1).
    * @param pid[IN] page to write to
@@ -67,7 +205,39 @@ class PageFile {
   PageId endPid() const;
 
   /**
-   * @return the total # of disk reads
+   * @return the page size of the file in bytes
+   */
+  int getPageSize() const { return pageSize; }
+
+  /**
+   * @return the format number kept in the header of the file by its
+   *   user, such as the record layout of a table. 0 if it was never set
+   */
+  int getFormat() const { return format; }
+
+  /**
+   * store a format number in the header of the file.
+   * a file without a header can only have format 0.
+   * @param f[IN] the format number
+   * @return error code. 0 if no error
+   */
+  RC setFormat(int f);
+
+  /**
+   * set the page size of the files created from now on.
+   * @param size[IN] a power of 2 between MIN_PAGE_SIZE and MAX_PAGE_SIZE
+   * @return error code. 0 if no error
+   */
+  static RC setDefaultPageSize(int size);
+
+  /**
+   * @return the page size of the files created from now on
+   */
+  static int getDefaultPageSize() { return defaultPageSize; }
+
+  /**
+   * @return the total # of disk reads. a page of a memory-mapped file
+   * counts as read the first time it is touched
    */
   static int getPageReadCount()  { return readCount; }
   
@@ -76,37 +246,189 @@ class PageFile {
    */
   static int getPageWriteCount() { return writeCount; }
 
+  /**
+   * @return the total # of pages read ahead with prefetch()
+   */
+  static int getPagePrefetchCount() { return prefetchCount; }
+
+  /**
+   * choose between write-back (the default) and write-through
+   * for all files.
+   * @param on[IN] true for write-back, false for write-through
+   */
+  static void setWriteBack(bool on) { writeBack = on; }
+
+  /**
+   * choose whether the files opened in 'r' mode from now on are
+   * memory-mapped.
+   * @param on[IN] true to map read-only files
+   */
+  static void setMemoryMap(bool on) { memoryMap = on; }
+
+  /**
+   * choose whether the files opened in 'r' mode from now on read their
+   * pages with O_DIRECT while they are scanned, i.e., after
+   * advise(SEQUENTIAL). a large scan then does not push the rest of the
+   * kernel page cache out. a file is read with O_DIRECT only if its
+   * page size and the offset of its first page are multiples of the
+   * block size the device needs. other files, and files that do not
+   * support O_DIRECT, are read through the page cache.
+   * @param on[IN] true to scan read-only files with O_DIRECT
+   */
+  static void setDirectIO(bool on) { directIO = on; }
+
+  /**
+   * @return true if the files opened in 'r' mode are scanned with O_DIRECT
+   */
+  static bool getDirectIO() { return directIO; }
+
+  /**
+   * @return true if a scan of the file reads its pages with O_DIRECT
+   */
+  bool canReadDirect() const { return directFd >= 0 && !directFailed; }
+
+  /**
+   * @return the block size O_DIRECT needs for the file. 0 if the file
+   *   was not opened for O_DIRECT scans or the file system refused it
+   */
+  int getDirectAlign() const { return directAlign; }
+
+  /**
+   * choose whether batches of pages are read and written through
+   * io_uring. without kernel support, the pages are read and written
+   * one at a time as before.
+   * @param on[IN] true to use io_uring
+   */
+  static void setAsyncIO(bool on) { asyncIO = on; }
+
+  /**
+   * @return true if batches of pages go through io_uring when possible
+   */
+  static bool getAsyncIO() { return asyncIO; }
+
  protected:
   /**
-   * move the file cursor to the beginning of a page.
-   * this is an internal function not exposed to public.
-   * @param pid[IN] page to seek to
+   * @param pid[IN] a page of the file
+   * @return the file offset of the page
+   */
+  off_t offsetOf(PageId pid) const { return dataOffset + (off_t)pid * pageSize; }
+
+  /**
+   * read a disk page with O_DIRECT, bypassing the kernel page cache.
+   * @param pid[IN] the page to read
+   * @param buffer[OUT] pointer to memory buffer
+   * @return error code. 0 if no error
+   */
+  RC readDirect(PageId pid, void *buffer) const;
+
+  /**
+   * open directFd if the file can be read with O_DIRECT, and set
+   * directAlign to the block size it needs.
+   * @param filename[IN] the name of the file
+   */
+  void openDirect(const std::string& filename);
+
+  /**
+   * ask the kernel to read count pages from pid into its cache.
+   * @param pid[IN] the first page
+   * @param count[IN] the number of pages
    * @return error code. 0 if no error
    */
-  RC seek(PageId pid) const;
+  RC adviseWillNeed(PageId pid, int count) const;
+
+  /**
+   * read the file header, or write it if the file is new, and set
+   * pageSize and dataOffset accordingly.
+   * @param size[IN] the size of the file in bytes
+   * @return error code. 0 if no error
+   */
+  RC setupHeader(off_t size);
+
+  /**
+   * read a disk page directly, bypassing the buffer pool.
+   * the buffer pool calls this function when a page is not cached.
+   * @param pid[IN] the page to read
+   * @param buffer[OUT] pointer to memory buffer
+   * @return error code. 0 if no error
+   */
+  RC readPage(PageId pid, void *buffer) const;
+
+  /**
+   * write consecutive disk pages directly, bypassing the buffer pool.
+   * the buffer pool calls this function to write back dirty pages.
+   * @param pid[IN] the first page to write
+   * @param pages[IN] the content of the pages pid, pid+1, ...
+   * @param count[IN] the number of pages to write
+   * @return error code. 0 if no error
+   */
+  RC writePages(PageId pid, char* const* pages, int count);
+
+  /**
+   * map the file, or map it again after it has grown, and update
+   * endPid() to its size.
+   * @return error code. 0 if no error
+   */
+  RC remap() const;
+
+  /**
+   * @param pid[IN] a page below endPid() of a mapped file
+   * @return the pointer to the page in the mapping
+   */
+  char* mappedPage(PageId pid) const;
 
  private:
-  int     fd;     // file descriptor of the associated unix file
-  PageId  epid;   // (last page id + 1) of the file
+  friend class BufferPool;
 
-  //
-  // the following set of members implement LRU caching 
-  //
-  static const int CACHE_COUNT = 10;
+  // the bounce buffer and the mappings belong to one file
+  PageFile(const PageFile&);
+  PageFile& operator=(const PageFile&);
 
-  static int cacheClock; // clock tick counter for LRU policy
+  int     fd;         // file descriptor of the associated unix file
+  int     directFd;   // the file opened with O_DIRECT. -1 if not open
+  int     directAlign;  // the block size O_DIRECT needs. 0 if not known
+  mutable bool directReads;  // read pages through directFd
+  mutable bool directFailed; // an O_DIRECT read failed. read through
+                             //   the page cache from then on
+  char*   bounce;     // an aligned page for reads into unaligned buffers
+  mutable pthread_mutex_t bounceLatch;
+  mutable PageId epid;  // (last page id + 1) of the file
+  int     pageSize;   // the size of a page of the file
+  off_t   dataOffset; // the file offset of page 0 (the header size)
+  int     format;     // the format number in the header
+
+  // the mapping of a read-only file. a mapping replaced by remap() may
+  // still be referenced by PageGuards, so it is unmapped only at close
+  struct Mapping {
+    char*  addr;
+    size_t size;
+  };
+  mutable Mapping map;                    // addr is NULL if not mapped
+  mutable std::vector<Mapping> retired;   // older mappings of the file
+  mutable std::vector<char> touched;      // pages read from the mapping
+  mutable Access access;                  // the last advise() hint
+
+  /**
+   * the header block at the beginning of the file.
+   * it takes a whole page so that the pages stay aligned.
+   */
+  struct Header {
+    int magic;      // HEADER_MAGIC
+    int version;    // HEADER_VERSION
+    int pageSize;   // the page size of the file
+    int format;     // set by the user of the file. 0 in older headers
+  };
+  static const int HEADER_MAGIC = 0x53425242;   // "BRBS"
+  static const int HEADER_VERSION = 1;
 
-  // the actual cache data structure
-  static struct cacheStruct {
-    int    fd;              // file id of the cached page
-    PageId pid;             // page id of the cached page
-    int    lastAccessed;    // the last time the cached page was accessed
-                            //   (lastAccessed == 0) means that the buffer is empty
-    char buffer[PAGE_SIZE]; // the buffer used for caching
-  } readCache[CACHE_COUNT];
+  static int defaultPageSize;  // page size of newly created files
 
   static int readCount;  // total # of page reads 
   static int writeCount; // total # of page writes 
+  static int prefetchCount; // total # of pages read ahead
+  static bool writeBack; // keep written pages in the buffer pool
+  static bool memoryMap; // map the files opened in 'r' mode
+  static bool directIO;  // scan the files opened in 'r' mode with O_DIRECT
+  static bool asyncIO;   // read and write batches through io_uring
 };
   
 #endif // PAGEFILE_H
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+#include "Predicate.h"
+#include "KeySearch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+Predicate::RangeKernel Predicate::rangeKernel = Predicate::pickKernel();
+
+Predicate::RangeKernel Predicate::pickKernel()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  if (KeySearch::hasAVX2()) return avx2Range;
+#endif
+  return scalarRange;
+}
+
+Predicate::Predicate()
+{
+  lo = INT_MIN;
+  hi = INT_MAX;
+}
+
+void Predicate::compile(const vector<SelCond>& conds)
+{
+  vector<int> notEqual;
+
+  lo = INT_MIN;
+  hi = INT_MAX;
+  excluded.clear();
+  terms.clear();
+
+  for (unsigned i = 0; i < conds.size(); i++) {
+    if (conds[i].attr == 2) {
+      Term t;
+      t.comp = conds[i].comp;
+      t.value = conds[i].value;
+      terms.push_back(t);
+      continue;
+    }
+
+    // narrow the interval of the keys
+    long long v = atoi(conds[i].value);
+    switch (conds[i].comp) {
+    case SelCond::EQ: lo = max(lo, v); hi = min(hi, v); break;
+    case SelCond::GT: lo = max(lo, v + 1); break;
+    case SelCond::GE: lo = max(lo, v); break;
+    case SelCond::LT: hi = min(hi, v - 1); break;
+    case SelCond::LE: hi = min(hi, v); break;
+    case SelCond::NE: notEqual.push_back(v); break;
+    }
+  }
+
+  // only the excluded keys inside the interval matter, each once
+  for (unsigned i = 0; i < notEqual.size(); i++) {
+    int v = notEqual[i];
+    if (v < lo || v > hi) continue;
+    if (find(excluded.begin(), excluded.end(), v) == excluded.end()) excluded.push_back(v);
+  }
+
+  stable_sort(terms.begin(), terms.end(), before);
+}
+
+int Predicate::rank(SelCond::Comparator comp)
+{
+  switch (comp) {
+  case SelCond::EQ: return 0;
+  case SelCond::NE: return 2;
+  default:          return 1;
+  }
+}
+
+bool Predicate::before(const Term& t1, const Term& t2)
+{
+  return rank(t1.comp) < rank(t2.comp);
+}
+
+bool Predicate::matchValue(const char* value) const
+{
+  for (unsigned i = 0; i < terms.size(); i++) {
+    int diff = strcmp(value, terms[i].value.c_str());
+    switch (terms[i].comp) {
+    case SelCond::EQ: if (diff != 0) return false; break;
+    case SelCond::NE: if (diff == 0) return false; break;
+    case SelCond::GT: if (diff <= 0) return false; break;
+    case SelCond::LT: if (diff >= 0) return false; break;
+    case SelCond::GE: if (diff < 0) return false; break;
+    case SelCond::LE: if (diff > 0) return false; break;
+    }
+  }
+  return true;
+}
+
+int Predicate::filterKeys(const int* keys, int n, int* sel) const
+{
+  int count;
+
+  if (isEmpty()) return 0;
+
+  // lo and hi of a non-empty interval are within the range of int
+  count = rangeKernel(keys, n, (int)lo, (int)hi, sel);
+  if (excluded.empty()) return count;
+
+  // the excluded keys are rare. they are taken out of the selection
+  int kept = 0;
+  for (int i = 0; i < count; i++) {
+    if (find(excluded.begin(), excluded.end(), keys[sel[i]]) == excluded.end()) {
+      sel[kept++] = sel[i];
+    }
+  }
+  return kept;
+}
+
+int Predicate::scalarRange(const int* keys, int n, int lo, int hi, int* sel)
+{
+  int count = 0;
+
+  // the position is stored unconditionally and the count only advances
+  // on a match, so the loop has no data-dependent branch
+  for (int i = 0; i < n; i++) {
+    sel[count] = i;
+    count += (keys[i] >= lo) & (keys[i] <= hi);
+  }
+  return count;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+__attribute__((target("avx2")))
+int Predicate::avx2Range(const int* keys, int n, int lo, int hi, int* sel)
+{
+  __m256i vlo = _mm256_set1_epi32(lo);
+  __m256i vhi = _mm256_set1_epi32(hi);
+  int count = 0;
+  int i = 0;
+
+  // a key is outside the interval if lo > key or key > hi. the bits of
+  // the other keys give their positions
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(keys + i));
+    __m256i out = _mm256_or_si256(_mm256_cmpgt_epi32(vlo, v), _mm256_cmpgt_epi32(v, vhi));
+    unsigned mask = ~_mm256_movemask_ps(_mm256_castsi256_ps(out)) & 0xff;
+    while (mask != 0) {
+      sel[count++] = i + __builtin_ctz(mask);
+      mask &= mask - 1;
+    }
+  }
+  for (; i < n; i++) {
+    sel[count] = i;
+    count += (keys[i] >= lo) & (keys[i] <= hi);
+  }
+  return count;
+}
+
+#endif
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef PREDICATE_H
+#define PREDICATE_H
+
+#include <string>
+#include <vector>
+#include "Bruinbase.h"
+#include "SqlEngine.h"
+
+/**
+ * The conditions of a WHERE clause, compiled once per query.
+ * The conditions on the key are folded into one interval [lo, hi] and a
+ * list of excluded keys (from <>), with the constants parsed once.
+ * The conditions on the value are kept as terms ordered by how many
+ * tuples they are expected to reject: = first, then the range
+ * comparisons, and <> last, so a tuple usually fails at the first term.
+ */
+class Predicate {
+ public:
+  Predicate();
+
+  /**
+   * compile the conditions of a WHERE clause.
+   * @param conds[IN] the conditions, ANDed together
+   */
+  void compile(const std::vector<SelCond>& conds);
+
+  /**
+   * @return the smallest key that can match
+   */
+  long long getLow() const { return lo; }
+
+  /**
+   * @return the largest key that can match
+   */
+  long long getHigh() const { return hi; }
+
+  /**
+   * @return the keys excluded with <> inside [getLow(), getHigh()],
+   * each key once
+   */
+  const std::vector<int>& getExcludedKeys() const { return excluded; }
+
+  /**
+   * @return true if no tuple can match
+   */
+  bool isEmpty() const { return lo > hi; }
+
+  /**
+   * @return true if there are conditions on the value
+   */
+  bool hasValueTerms() const { return !terms.empty(); }
+
+  /**
+   * @param key[IN] the key of a tuple
+   * @return true if the key meets the conditions on the key
+   */
+  bool matchKey(int key) const
+  {
+    if (key < lo || key > hi) return false;
+    for (unsigned i = 0; i < excluded.size(); i++) {
+      if (key == excluded[i]) return false;
+    }
+    return true;
+  }
+
+  /**
+   * @param value[IN] the value of a tuple
+   * @return true if the value meets the conditions on the value
+   */
+  bool matchValue(const char* value) const;
+
+  /**
+   * select the keys of a batch that meet the conditions on the key.
+   * the interval is checked eight keys at a time with AVX2 on x86
+   * processors that support it.
+   * @param keys[IN] the keys of the batch
+   * @param n[IN] the number of keys
+   * @param sel[OUT] the positions of the selected keys, in order
+   * @return the number of selected keys
+   */
+  int filterKeys(const int* keys, int n, int* sel) const;
+
+ private:
+  struct Term {
+    SelCond::Comparator comp;
+    std::string value;
+  };
+
+  typedef int (*RangeKernel)(const int* keys, int n, int lo, int hi, int* sel);
+
+  // select the positions of the keys in [lo, hi]
+  static int scalarRange(const int* keys, int n, int lo, int hi, int* sel);
+#if defined(__x86_64__) || defined(__i386__)
+  static int avx2Range(const int* keys, int n, int lo, int hi, int* sel);
+#endif
+
+  // choose the fastest kernel the processor supports
+  static RangeKernel pickKernel();
+
+  static RangeKernel rangeKernel;
+
+  // the order in which the value terms are evaluated
+  static int rank(SelCond::Comparator comp);
+  static bool before(const Term& t1, const Term& t2);
+
+  long long lo;               // the interval of matching keys
+  long long hi;
+  std::vector<int> excluded;  // keys excluded with <>
+  std::vector<Term> terms;    // the conditions on the value
+};
+
+#endif // PREDICATE_H
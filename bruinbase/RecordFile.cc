@@ -7,6 +7,9 @@
  * @date 3/24/2008
  */
 
+#include <cstring>
+#include <vector>
+#include <algorithm>
 #include "Bruinbase.h"
 #include "RecordFile.h"
 
@@ -23,7 +26,7 @@ static char* slotPtr(char* page, int n);
 static void readSlot(const char* page, int n, int& key, std::string& value);
 
 // write the record to the n'th slot in the page
-static void writeSlot(char* page, int n, int key, const std::string& value);
+static void writeSlot(char* page, int n, int key, const char* value, int length);
 
 // get # records stored in the page
 static int getRecordCount(const char* page);
@@ -31,36 +34,50 @@ static int getRecordCount(const char* page);
 // update # records stored in the page
 static void setRecordCount(char* page, int count);
 
+// read/write an int at p
+static int getInt(const char* p);
+static void setInt(char* p, int v);
 
 //
-// helper functions for RecordId manipulation
+// the SLOTTED layout. a page starts with # records, # records in the
+// earlier pages and the offset of the first record, followed by the
+// offsets of the records. an overflow page starts with OVERFLOW_PAGE,
+// the next page of the chain (-1 at the end) and # value bytes in it
 //
+static const int SLOTTED_HEADER = 3 * sizeof(int);
+static const int OVERFLOW_HEADER = 3 * sizeof(int);
+static const int OVERFLOW_PAGE = -1;
 
-// postfix record id iterator
-RecordId operator++ (RecordId& rid, int)
-{
-  RecordId prid(rid);
+// set up an empty page in the SLOTTED layout
+static void initSlottedPage(char* page, int size, int base);
 
-  // if the end of a page is reached, move to the next page
-  if (++rid.sid >= RecordFile::RECORDS_PER_PAGE) {
-    rid.pid++;
-    rid.sid = 0;
-  }
+// compute the pointer to the record in the n'th slot of a SLOTTED page
+static const char* slottedRecord(const char* page, int n);
 
-  return prid;
-}
+//
+// the DICTIONARY layout. a page starts with # records, # records in the
+// earlier pages and # distinct values. overflow pages are as in SLOTTED
+//
+static const int DICTIONARY_HEADER = 3 * sizeof(int);
 
-// prefix record id iterator
-RecordId& operator++ (RecordId& rid)
-{
-  // if the end of a page is reached, move to the next page
-  if (++rid.sid >= RecordFile::RECORDS_PER_PAGE) {
-    rid.pid++;
-    rid.sid = 0;
-  } 
+// read/write the 2-byte numbers of a DICTIONARY page
+static int getShort(const char* p);
+static void setShort(char* p, int v);
 
-  return rid;
-}
+// compute the pointer to the value of code c of a DICTIONARY page.
+// it starts with the length of the value
+static const char* dictionaryValue(const char* page, int c);
+
+// the bytes a value takes in a DICTIONARY page, without its offset
+static int entrySize(int length, int limit);
+
+// hash the bytes of a value
+static unsigned hashBytes(const char* value, int length);
+
+
+//
+// helper functions for RecordId manipulation
+//
 
 // RecordId comparators
 bool operator < (const RecordId& r1, const RecordId& r2)
@@ -102,29 +119,86 @@ bool operator != (const RecordId& r1, const RecordId& r2)
 }
 
 
+RecordFile::Layout RecordFile::defaultLayout = RecordFile::SLOTTED;
+
+RC RecordFile::setDefaultLayout(Layout l)
+{
+  if (l != SLOTTED && l != DICTIONARY) return RC_INVALID_ATTRIBUTE;
+  defaultLayout = l;
+  return 0;
+}
+
 RecordFile::RecordFile()
 {
   erid.pid = 0;
   erid.sid = 0;
+  layout = FIXED;
+  tailPid = -1;
+  dirty = false;
+  base = 0;
+  nextPid = 0;
+  countPid = -1;
 }
 
 RecordFile::RecordFile(const string& filename, char mode)
 {
+  layout = FIXED;
+  tailPid = -1;
+  dirty = false;
+  base = 0;
+  nextPid = 0;
+  countPid = -1;
   open(filename, mode);
 }
 
 RC RecordFile::open(const string& filename, char mode)
 {
-  RC   rc;
-  char page[PageFile::PAGE_SIZE];
+  RC        rc;
+  PageGuard page;
 
   // open the page file
   if ((rc = pf.open(filename, mode)) < 0) return rc;
+  tailPid = -1;
+  dirty = false;
+  countPid = -1;
+
+  // a new file gets the default layout. (a file without a header
+  // cannot store it and keeps the FIXED layout.)
+  if (pf.endPid() == 0 && (mode == 'w' || mode == 'W')) pf.setFormat(defaultLayout);
+  layout = (Layout)pf.getFormat();
+  if (layout != FIXED && layout != SLOTTED && layout != DICTIONARY) {
+    pf.close();
+    return RC_INVALID_FILE_FORMAT;
+  }
   
   //
   // in the rest of this function, we set the end record id
   //
 
+  // in the SLOTTED and DICTIONARY layouts, the records end in the last
+  // page that is not an overflow page. new pages go after the end of
+  // the file
+  if (layout != FIXED) {
+    erid.pid = nextPid = pf.endPid();
+    erid.sid = 0;
+    base = 0;
+    for (PageId pid = nextPid - 1; pid >= 0; pid--) {
+      if ((rc = pf.fetch(pid, page)) < 0) {
+        erid.pid = erid.sid = 0;
+        pf.close();
+        return rc;
+      }
+      int count = ::getRecordCount(page.data());
+      if (count != OVERFLOW_PAGE) {
+        erid.pid = pid;
+        erid.sid = count;
+        base = getInt(page.data() + sizeof(int));
+        break;
+      }
+    }
+    return 0;
+  }
+
   // get the end pid of the file
   erid.pid = pf.endPid();
 
@@ -138,7 +212,7 @@ RC RecordFile::open(const string& filename, char mode)
   // obtain # records in the last page to set sid of the end record id.
   // read the last page of the file and get # records in the page.
   // remeber that the id of the last page is endPid()-1 not endPid().
-  if ((rc = pf.read(--erid.pid, page)) < 0) {
+  if ((rc = pf.fetch(--erid.pid, page)) < 0) {
     // an error occurred during page read
     erid.pid = erid.sid = 0;
     pf.close();
@@ -146,8 +220,8 @@ RC RecordFile::open(const string& filename, char mode)
   }
 
   // get # records in the last page
-  erid.sid = getRecordCount(page);
-  if (erid.sid >= RECORDS_PER_PAGE) {
+  erid.sid = ::getRecordCount(page.data());
+  if (erid.sid >= getRecordsPerPage()) {
     // the last page is full. advance the end record id to the next page.
     erid.pid++;
     erid.sid = 0;
@@ -158,70 +232,698 @@ RC RecordFile::open(const string& filename, char mode)
 
 RC RecordFile::close()
 {
+  RC rc = flush();
+
   erid.pid = 0;
   erid.sid = 0;
+  tailPid = -1;
+  countPid = -1;
+
+  RC rc2 = pf.close();
+  return (rc < 0) ? rc : rc2;
+}
+
+RC RecordFile::flush()
+{
+  RC rc;
 
-  return pf.close();
+  if (!dirty) return 0;
+  if ((rc = pf.write(tailPid, &tail[0])) < 0) return rc;
+  dirty = false;
+  return 0;
+}
+
+RC RecordFile::fetchPage(PageId pid, PageGuard& page, const char*& data) const
+{
+  RC rc;
+
+  if (dirty && pid == tailPid) {
+    page.release();
+    data = &tail[0];
+    return 0;
+  }
+  if ((rc = pf.fetch(pid, page)) < 0) return rc;
+  data = page.data();
+  return 0;
 }
 
 RC RecordFile::read(const RecordId& rid, int& key, string& value) const
 {
-  RC   rc;
-  char page[PageFile::PAGE_SIZE];
+  RC        rc;
+  PageGuard page;
+  const char* data;
   
   // check whether the rid is in the valid range
   if (rid.pid < 0 || rid.pid > erid.pid) return RC_INVALID_RID;
-  if (rid.sid < 0 || rid.sid >= RecordFile::RECORDS_PER_PAGE) return RC_INVALID_RID;
+  if (rid.sid < 0 || rid.sid >= getRecordsPerPage()) return RC_INVALID_RID;
   if (rid >= erid) return RC_INVALID_RID;
   
-  // read the page containing the record
-  if ((rc = pf.read(rid.pid, page)) < 0) return rc;
+  // pin the page containing the record
+  if ((rc = fetchPage(rid.pid, page, data)) < 0) return rc;
+
+  // read the record straight from the slot in the frame
+  return readRecord(data, rid.sid, key, value);
+}
+
+RC RecordFile::readKey(const RecordId& rid, int& key) const
+{
+  RC        rc;
+  PageGuard page;
+  const char* data;
+
+  // check whether the rid is in the valid range
+  if (rid.pid < 0 || rid.pid > erid.pid) return RC_INVALID_RID;
+  if (rid.sid < 0 || rid.sid >= getRecordsPerPage()) return RC_INVALID_RID;
+  if (rid >= erid) return RC_INVALID_RID;
+
+  // pin the page containing the record and copy the key from the slot
+  if ((rc = fetchPage(rid.pid, page, data)) < 0) return rc;
+  if (layout != FIXED && rid.sid >= ::getRecordCount(data)) return RC_INVALID_RID;
+  if (layout == SLOTTED) {
+    memcpy(&key, slottedRecord(data, rid.sid), sizeof(int));
+  } else if (layout == DICTIONARY) {
+    memcpy(&key, data + DICTIONARY_HEADER + rid.sid * sizeof(int), sizeof(int));
+  } else {
+    memcpy(&key, slotPtr(const_cast<char*>(data), rid.sid), sizeof(int));
+  }
+
+  return 0;
+}
 
-  // read the record from the slot in the page
-  readSlot(page, rid.sid, key, value);
+// orders the positions of a RecordId array by the RecordIds
+struct RidOrder {
+  const RecordId* rids;
+  RidOrder(const RecordId* r) : rids(r) { }
+  bool operator() (int i, int j) const { return rids[i] < rids[j]; }
+};
 
+RC RecordFile::readMany(const RecordId* rids, int count, int* keys, string* values) const
+{
+  RC          rc;
+  PageGuard   page;
+  const char* data = NULL;   // the page of the record
+  PageId      pid = -1;
+  std::vector<int> order(count);
+  std::vector<PageId> pids;  // the pages of the records, in order
+  int         cur = -1;      // pids[cur] is the pinned page
+  int         ahead = 0;     // pids[ahead] is the next page to read ahead
+
+  // sort the positions of the records by page
+  for (int i = 0; i < count; i++) order[i] = i;
+  std::sort(order.begin(), order.end(), RidOrder(rids));
+
+  // the pages, each once in page order
+  for (int i = 0; i < count; i++) {
+    PageId pid = rids[order[i]].pid;
+    if (pids.empty() || pids.back() != pid) pids.push_back(pid);
+  }
+
+  for (int i = 0; i < count; i++) {
+    const RecordId& rid = rids[order[i]];
+
+    // check whether the rid is in the valid range
+    if (rid.pid < 0 || rid.pid > erid.pid) return RC_INVALID_RID;
+    if (rid.sid < 0 || rid.sid >= getRecordsPerPage()) return RC_INVALID_RID;
+    if (rid >= erid) return RC_INVALID_RID;
+
+    // the page stays pinned for the following records on it. the next
+    // READ_AHEAD_PAGES pages are asked for when those asked for before
+    // are used up. a single page is just read
+    if (data == NULL || pid != rid.pid) {
+      if (++cur == ahead) {
+        int n = pids.size() - ahead;
+        if (n > READ_AHEAD_PAGES) n = READ_AHEAD_PAGES;
+        if (n > 1) pf.prefetch(&pids[ahead], n);
+        ahead += n;
+      }
+      if ((rc = fetchPage(rid.pid, page, data)) < 0) return rc;
+      pid = rid.pid;
+    }
+    if ((rc = readRecord(data, rid.sid, keys[order[i]], values[order[i]])) < 0) return rc;
+  }
+
+  return 0;
+}
+
+RC RecordFile::readRecord(const char* page, int sid, int& key, string& value) const
+{
+  if (layout == FIXED) {
+    readSlot(page, sid, key, value);
+    return 0;
+  }
+
+  // the slot must be in the directory of the page. an overflow page
+  // has no slots
+  int count = ::getRecordCount(page);
+  if (sid >= count) return RC_INVALID_RID;
+
+  // the value of a DICTIONARY record is found through its code
+  if (layout == DICTIONARY) {
+    const char* v = dictionaryValue(page, getShort(page + DICTIONARY_HEADER + count * sizeof(int) + sid * 2));
+    int length = getInt(v);
+    key = getInt(page + DICTIONARY_HEADER + sid * sizeof(int));
+    if (length > inlineLimit()) return readOverflow(getInt(v + sizeof(int)), length, value);
+    value.assign(v + sizeof(int), length);
+    return 0;
+  }
+
+  const char* rec = slottedRecord(page, sid);
+  int length = getInt(rec + sizeof(int));
+  key = getInt(rec);
+
+  // a long value is in overflow pages
+  if (length > inlineLimit()) return readOverflow(getInt(rec + 2 * sizeof(int)), length, value);
+  value.assign(rec + 2 * sizeof(int), length);
+  return 0;
+}
+
+RC RecordFile::resolveValue(const char* v, const char*& value, std::deque<string>& longs) const
+{
+  RC  rc;
+  int length = getInt(v);
+
+  if (length <= inlineLimit()) {
+    value = v + sizeof(int);
+    return 0;
+  }
+  longs.push_back(string());
+  if ((rc = readOverflow(getInt(v + sizeof(int)), length, longs.back())) < 0) return rc;
+  value = longs.back().c_str();
+  return 0;
+}
+
+RC RecordFile::readOverflow(PageId pid, int length, string& value) const
+{
+  RC          rc;
+  PageGuard   page;
+  const char* data;
+  int         room = pf.getPageSize() - OVERFLOW_HEADER;
+
+  value.erase();
+  value.reserve(length);
+
+  // follow the chain until the whole value is read
+  while ((int)value.size() < length) {
+    if (pid < 0) return RC_INVALID_FILE_FORMAT;
+    if ((rc = fetchPage(pid, page, data)) < 0) return rc;
+
+    int n = getInt(data + 2 * sizeof(int));
+    if (::getRecordCount(data) != OVERFLOW_PAGE || n <= 0 || n > room) return RC_INVALID_FILE_FORMAT;
+    value.append(data + OVERFLOW_HEADER, n);
+    pid = getInt(data + sizeof(int));
+  }
   return 0;
 }
 
 RC RecordFile::append(int key, const std::string& value, RecordId& rid)
 {
-  RC   rc;
-  char page[PageFile::PAGE_SIZE];
+  return append(key, value.data(), value.size(), rid);
+}
 
-  // unless we are writing to the the first slot of an empty page,
-  // we have to read the page first
-  if (erid.sid > 0) {
-    if ((rc = pf.read(erid.pid, page)) < 0) return rc;
-  } else {
-    // if this is the first slot of an empty page
-    // we can simply initialize the page with zeros
-    memset(page, 0, PageFile::PAGE_SIZE);
+RC RecordFile::append(int key, const char* value, int length, RecordId& rid)
+{
+  return appendMany(&key, &value, &length, 1, rid);
+}
+
+RC RecordFile::appendMany(const int* keys, const char* const* values, const int* lengths,
+                          int count, RecordId& first)
+{
+  if (layout == SLOTTED) return appendSlotted(keys, values, lengths, count, first);
+  if (layout == DICTIONARY) return appendDictionary(keys, values, lengths, count, first);
+  return appendFixed(keys, values, lengths, count, first);
+}
+
+RC RecordFile::appendFixed(const int* keys, const char* const* values, const int* lengths,
+                           int count, RecordId& first)
+{
+  RC  rc;
+  int perPage = getRecordsPerPage();
+
+  first = erid;
+  for (int i = 0; i < count; ) {
+    // start filling the last page. an empty page is initialized with
+    // zeros, and a partly filled one is read once
+    if (tailPid != erid.pid) {
+      tail.resize(pf.getPageSize());
+      if (erid.sid == 0) {
+        memset(&tail[0], 0, tail.size());
+      } else if ((rc = pf.read(erid.pid, &tail[0])) < 0) {
+        return rc;
+      }
+      tailPid = erid.pid;
+    }
+
+    // write the records to the empty slots of the page
+    int n = perPage - erid.sid;
+    if (n > count - i) n = count - i;
+    for (int j = 0; j < n; j++) {
+      writeSlot(&tail[0], erid.sid + j, keys[i + j], values[i + j], lengths[i + j]);
+    }
+
+    // the first four bytes in the page stores # records in the page.
+    // update this number.
+    setRecordCount(&tail[0], erid.sid + n);
+    dirty = true;
+
+    // a full page is written now. the last page waits for more records
+    if (erid.sid + n >= perPage && (rc = flush()) < 0) return rc;
+
+    // advance the end record id to the next empty slot
+    i += n;
+    erid.sid += n;
+    if (erid.sid >= perPage) {
+      erid.pid++;
+      erid.sid = 0;
+    }
   }
-    
-  // write the record to the first empty slot 
-  writeSlot(page, erid.sid, key, value);
 
-  // the first four bytes in the page stores # records in the page.
-  // update this number.
-  setRecordCount(page, erid.sid + 1);
+  return 0;
+}
 
-  // write the page to the disk
-  if ((rc = pf.write(erid.pid, page)) < 0) return rc;
-    
-  // we need to output the rid of the record slot
-  rid = erid;
+RC RecordFile::appendSlotted(const int* keys, const char* const* values, const int* lengths,
+                             int count, RecordId& first)
+{
+  RC  rc;
+  int limit = inlineLimit();
 
-  // advance the end record id by one to the next empty slot
-  ++erid;
+  first = erid;
+  for (int i = 0; i < count; i++) {
+    bool inlined = (lengths[i] <= limit);
+    int  size = 2 * sizeof(int) + (inlined ? lengths[i] + 1 : sizeof(PageId));
+
+    // start filling the last page. a new page is set up empty, and
+    // a partly filled one is read once
+    if (tailPid != erid.pid) {
+      tail.resize(pf.getPageSize());
+      if (erid.sid == 0) {
+        initSlottedPage(&tail[0], tail.size(), base);
+      } else if ((rc = pf.read(erid.pid, &tail[0])) < 0) {
+        return rc;
+      }
+      tailPid = erid.pid;
+      if (nextPid <= erid.pid) nextPid = erid.pid + 1;
+    }
+
+    // the record and its directory entry must fit between the directory
+    // and the other records. otherwise the page is done, and the next
+    // one follows the overflow pages written so far
+    char* page = &tail[0];
+    int   start = getInt(page + 2 * sizeof(int));
+    if (start - SLOTTED_HEADER - (erid.sid + 1) * (int)sizeof(int) < size) {
+      if ((rc = flush()) < 0) return rc;
+      base += erid.sid;
+      erid.pid = tailPid = nextPid++;
+      erid.sid = 0;
+      initSlottedPage(page, tail.size(), base);
+      start = tail.size();
+    }
+
+    // a long value is written to overflow pages first
+    PageId chain = -1;
+    if (!inlined && (rc = writeOverflow(values[i], lengths[i], chain)) < 0) return rc;
+
+    // store the record in front of the others and add it to the directory
+    start -= size;
+    char* rec = page + start;
+    setInt(rec, keys[i]);
+    setInt(rec + sizeof(int), lengths[i]);
+    if (inlined) {
+      memcpy(rec + 2 * sizeof(int), values[i], lengths[i]);
+      rec[2 * sizeof(int) + lengths[i]] = 0;
+    } else {
+      setInt(rec + 2 * sizeof(int), chain);
+    }
+    setInt(page + SLOTTED_HEADER + erid.sid * sizeof(int), start);
+    setInt(page + 2 * sizeof(int), start);
+    setRecordCount(page, erid.sid + 1);
+    dirty = true;
+
+    if (i == 0) first = erid;
+    erid.sid++;
+  }
 
   return 0;
 }
 
+RC RecordFile::appendDictionary(const int* keys, const char* const* values, const int* lengths,
+                                int count, RecordId& first)
+{
+  RC  rc;
+  int limit = inlineLimit();
+  int pageSize = pf.getPageSize();
+
+  first = erid;
+  for (int i = 0; i < count; i++) {
+    // start filling the last page
+    if (tailPid != erid.pid) {
+      if ((rc = loadDictionary()) < 0) return rc;
+      tailPid = erid.pid;
+      if (nextPid <= erid.pid) nextPid = erid.pid + 1;
+    }
+
+    // a record takes its key and code. a value new to the page also
+    // takes its offset and its bytes
+    int code = findCode(values[i], lengths[i]);
+    int size = sizeof(int) + 2;
+    if (code < 0) size += 2 + entrySize(lengths[i], limit);
+
+    // otherwise the page is done, and the next one follows the overflow
+    // pages written so far
+    if (dict.bytes + size > pageSize) {
+      packDictionary();
+      if ((rc = flush()) < 0) return rc;
+      base += erid.sid;
+      erid.pid = tailPid = nextPid++;
+      erid.sid = 0;
+      if ((rc = loadDictionary()) < 0) return rc;
+      code = -1;
+      size = sizeof(int) + 2 + 2 + entrySize(lengths[i], limit);
+    }
+
+    // a long value is written to overflow pages once per page
+    if (code < 0) {
+      PageId chain = -1;
+      if (lengths[i] > limit && (rc = writeOverflow(values[i], lengths[i], chain)) < 0) return rc;
+      code = addValue(values[i], lengths[i], chain);
+    }
+    dict.keys.push_back(keys[i]);
+    dict.codes.push_back(code);
+    dict.bytes += size;
+    dirty = true;
+
+    if (i == 0) first = erid;
+    erid.sid++;
+  }
+
+  // the image is what flush() writes and the reads of the page see
+  if (dirty) packDictionary();
+  return 0;
+}
+
+RC RecordFile::loadDictionary()
+{
+  RC  rc;
+  int pageSize = pf.getPageSize();
+  int slots = 1;
+
+  // the hash table is at most half full
+  while (slots < 2 * (pageSize / 6 + 1)) slots <<= 1;
+  tail.resize(pageSize);
+  dict.keys.clear();
+  dict.codes.clear();
+  dict.values.clear();
+  dict.chains.clear();
+  dict.table.assign(slots, -1);
+  dict.bytes = DICTIONARY_HEADER;
+  if (erid.sid == 0) return 0;
+
+  // a partly filled page is read back once. its long values are read
+  // from their chains, so that they are found again
+  if ((rc = pf.read(erid.pid, &tail[0])) < 0) return rc;
+  const char* page = &tail[0];
+  int count = ::getRecordCount(page);
+  int codes = getInt(page + 2 * sizeof(int));
+  string value;
+  for (int c = 0; c < codes; c++) {
+    const char* v = dictionaryValue(page, c);
+    int length = getInt(v);
+    PageId chain = -1;
+    if (length > inlineLimit()) {
+      chain = getInt(v + sizeof(int));
+      if ((rc = readOverflow(chain, length, value)) < 0) return rc;
+    } else {
+      value.assign(v + sizeof(int), length);
+    }
+    addValue(value.data(), length, chain);
+    dict.bytes += 2 + entrySize(length, inlineLimit());
+  }
+  for (int sid = 0; sid < count; sid++) {
+    dict.keys.push_back(getInt(page + DICTIONARY_HEADER + sid * sizeof(int)));
+    dict.codes.push_back(getShort(page + DICTIONARY_HEADER + count * sizeof(int) + sid * 2));
+    dict.bytes += sizeof(int) + 2;
+  }
+  return 0;
+}
+
+void RecordFile::packDictionary()
+{
+  char* page = &tail[0];
+  int   count = dict.keys.size();
+  int   codes = dict.values.size();
+  int   limit = inlineLimit();
+
+  memset(page, 0, tail.size());
+  setRecordCount(page, count);
+  setInt(page + sizeof(int), base);
+  setInt(page + 2 * sizeof(int), codes);
+
+  // the keys, the codes, the offsets of the values and the values
+  char* p = page + DICTIONARY_HEADER;
+  for (int i = 0; i < count; i++, p += sizeof(int)) setInt(p, dict.keys[i]);
+  for (int i = 0; i < count; i++, p += 2) setShort(p, dict.codes[i]);
+  char* offsets = p;
+  p += codes * 2;
+  for (int c = 0; c < codes; c++) {
+    int length = dict.values[c].size();
+    setShort(offsets + c * 2, p - page);
+    setInt(p, length);
+    p += sizeof(int);
+    if (length > limit) {
+      setInt(p, dict.chains[c]);
+      p += sizeof(PageId);
+    } else {
+      memcpy(p, dict.values[c].data(), length);
+      p[length] = 0;
+      p += length + 1;
+    }
+  }
+}
+
+int RecordFile::findCode(const char* value, int length) const
+{
+  int mask = dict.table.size() - 1;
+
+  for (int h = hashBytes(value, length) & mask; dict.table[h] >= 0; h = (h + 1) & mask) {
+    const string& v = dict.values[dict.table[h]];
+    if ((int)v.size() == length && memcmp(v.data(), value, length) == 0) return dict.table[h];
+  }
+  return -1;
+}
+
+int RecordFile::addValue(const char* value, int length, PageId chain)
+{
+  int mask = dict.table.size() - 1;
+  int code = dict.values.size();
+  int h = hashBytes(value, length) & mask;
+
+  while (dict.table[h] >= 0) h = (h + 1) & mask;
+  dict.table[h] = code;
+  dict.values.push_back(string(value, length));
+  dict.chains.push_back(chain);
+  return code;
+}
+
+RC RecordFile::writeOverflow(const char* value, int length, PageId& first)
+{
+  RC  rc;
+  int room = pf.getPageSize() - OVERFLOW_HEADER;
+  std::vector<char> page(pf.getPageSize());
+
+  // the pages of a chain are consecutive
+  first = nextPid;
+  for (int done = 0; done < length; ) {
+    int    n = (length - done < room) ? length - done : room;
+    PageId pid = nextPid++;
+
+    memset(&page[0], 0, page.size());
+    setInt(&page[0], OVERFLOW_PAGE);
+    setInt(&page[sizeof(int)], (done + n < length) ? pid + 1 : -1);
+    setInt(&page[2 * sizeof(int)], n);
+    memcpy(&page[OVERFLOW_HEADER], value + done, n);
+    if ((rc = pf.write(pid, &page[0])) < 0) return rc;
+    done += n;
+  }
+  return 0;
+}
+
 const RecordId& RecordFile::endRid() const
 {
   return erid;
 }
 
+int RecordFile::getRecordCount() const
+{
+  if (layout != FIXED) return base + erid.sid;
+  return erid.pid * getRecordsPerPage() + erid.sid;
+}
+
+int RecordFile::countOf(PageId pid) const
+{
+  PageGuard   page;
+  const char* data;
+
+  // only the last page gains records, and next() does not look it up,
+  // so the count of a page does not change once it is remembered
+  if (pid != countPid) {
+    if (fetchPage(pid, page, data) < 0) return 0;
+    countVal = ::getRecordCount(data);
+    countPid = pid;
+  }
+  return countVal;
+}
+
+void RecordFile::next(RecordId& rid) const
+{
+  // in the SLOTTED and DICTIONARY layouts, the records of a page are
+  // counted in its header, and overflow pages are skipped. the last
+  // page ends at erid
+  if (layout != FIXED) {
+    rid.sid++;
+    if (rid.pid >= erid.pid || rid.sid < countOf(rid.pid)) return;
+    do { rid.pid++; } while (rid.pid < erid.pid && countOf(rid.pid) <= 0);
+    rid.sid = 0;
+    return;
+  }
+
+  // if the end of a page is reached, move to the next page
+  if (++rid.sid >= getRecordsPerPage()) {
+    rid.pid++;
+    rid.sid = 0;
+  }
+}
+
+int RecordFile::getRecordsPerPage() const
+{
+  // a SLOTTED record takes a directory entry, the key, the length and
+  // the NUL of its value at least
+  if (layout == SLOTTED) return (pf.getPageSize() - SLOTTED_HEADER) / (3 * sizeof(int) + 1);
+
+  // a DICTIONARY record takes its key and its code, if all records
+  // share one empty value
+  if (layout == DICTIONARY) {
+    return (pf.getPageSize() - DICTIONARY_HEADER - 2 - entrySize(0, 0)) / (sizeof(int) + 2);
+  }
+
+  return (pf.getPageSize() - sizeof(int)) / SLOT_SIZE;
+}
+
+RecordScan::RecordScan()
+{
+  file = NULL;
+  cursor.pid = cursor.sid = 0;
+}
+
+RC RecordScan::open(const RecordFile& f)
+{
+  close();
+  file = &f;
+  cursor.pid = cursor.sid = 0;
+
+  // the pages are read in order. a failed hint does not stop the scan
+  file->pf.advise(PageFile::SEQUENTIAL);
+  return 0;
+}
+
+RC RecordScan::nextBatch(int* keys, const char** values, int max, int& count)
+{
+  int codeCount;
+  return nextBatch(keys, values, NULL, max, count, codeCount);
+}
+
+RC RecordScan::nextBatch(int* keys, const char** values, int* codes, int max, int& count, int& codeCount)
+{
+  RC rc;
+
+  count = codeCount = 0;
+  close();
+  if (file == NULL || cursor >= file->erid) return RC_END_OF_INPUT;
+
+  // ask for the pages of the batch together. SLOTTED and DICTIONARY
+  // pages are taken to be as full as the average page of the file
+  int perPage = file->getRecordsPerPage();
+  int expect = perPage;
+  if (file->layout != RecordFile::FIXED) {
+    expect = file->getRecordCount() / (file->erid.pid + 1);
+    if (expect < 1) expect = 1;
+  }
+  int n = (cursor.sid + max + expect - 1) / expect;
+  if (n > MAX_PAGES) n = MAX_PAGES;
+  file->pf.prefetch(cursor.pid, n);
+
+  // the slots of a page are contiguous, so a page is walked with a pointer
+  for (int p = 0; p < MAX_PAGES && count < max && cursor < file->erid; ) {
+    const char* data;
+    if ((rc = file->fetchPage(cursor.pid, pages[p], data)) < 0) return rc;
+
+    if (file->layout != RecordFile::FIXED) {
+      // overflow pages are skipped. their values are read with the
+      // records that hold them
+      int records = getRecordCount(data);
+      int end = (cursor.pid == file->erid.pid) ? file->erid.sid : records;
+      if (end <= 0) {
+        pages[p].release();
+        cursor.pid++;
+        cursor.sid = 0;
+        continue;
+      }
+
+      // the keys of a DICTIONARY page are copied at once, and the value
+      // of a code is looked up for its first record only. the records
+      // with the same code share the value and the batch code
+      if (file->layout == RecordFile::DICTIONARY) {
+        int take = (end - cursor.sid < max - count) ? end - cursor.sid : max - count;
+        const char* pageCodes = data + DICTIONARY_HEADER + records * sizeof(int);
+        memcpy(&keys[count], data + DICTIONARY_HEADER + cursor.sid * sizeof(int), take * sizeof(int));
+        resolved.assign(getInt(data + 2 * sizeof(int)), NULL);
+        remap.assign(resolved.size(), -1);
+        for (int i = 0; i < take; i++, cursor.sid++, count++) {
+          int c = getShort(pageCodes + cursor.sid * 2);
+          if (resolved[c] == NULL) {
+            if ((rc = file->resolveValue(dictionaryValue(data, c), resolved[c], longValues)) < 0) return rc;
+            remap[c] = codeCount++;
+          }
+          values[count] = resolved[c];
+          if (codes != NULL) codes[count] = remap[c];
+        }
+      } else {
+        for (; cursor.sid < end && count < max; cursor.sid++, count++) {
+          const char* rec = slottedRecord(data, cursor.sid);
+          keys[count] = getInt(rec);
+          if ((rc = file->resolveValue(rec + sizeof(int), values[count], longValues)) < 0) return rc;
+          if (codes != NULL) codes[count] = codeCount++;
+        }
+      }
+      if (cursor.sid >= end && cursor.pid != file->erid.pid) {
+        cursor.pid++;
+        cursor.sid = 0;
+      }
+      p++;
+      continue;
+    }
+
+    int end = (cursor.pid == file->erid.pid) ? file->erid.sid : perPage;
+    const char* slot = slotPtr(const_cast<char*>(data), cursor.sid);
+    for (; cursor.sid < end && count < max; cursor.sid++, count++) {
+      memcpy(&keys[count], slot, sizeof(int));
+      values[count] = slot + sizeof(int);
+      if (codes != NULL) codes[count] = codeCount++;
+      slot += RecordFile::SLOT_SIZE;
+    }
+    if (cursor.sid >= perPage) {
+      cursor.pid++;
+      cursor.sid = 0;
+    }
+    p++;
+  }
+  return 0;
+}
+
+void RecordScan::close()
+{
+  for (int p = 0; p < MAX_PAGES && pages[p].isPinned(); p++) pages[p].release();
+  longValues.clear();
+}
+
 static int getRecordCount(const char* page)
 {
   int count;
@@ -243,7 +945,7 @@ static char* slotPtr(char* page, int n)
   // remember that the first four bytes in a page is used to store
   // # records in the page and each slot consists of an integer and
   // a string of length MAX_VALUE_LENGTH
-  return (page+sizeof(int)) + (sizeof(int)+RecordFile::MAX_VALUE_LENGTH)*n;
+  return (page+sizeof(int)) + RecordFile::SLOT_SIZE*n;
 }
 
 static void readSlot(const char* page, int n, int& key, std::string& value)
@@ -258,7 +960,7 @@ static void readSlot(const char* page, int n, int& key, std::string& value)
   value.assign(ptr + sizeof(int));
 }
 
-static void writeSlot(char* page, int n, int key, const std::string& value)
+static void writeSlot(char* page, int n, int key, const char* value, int length)
 {
   // compute the location of the record
   char *ptr = slotPtr(page, n);
@@ -267,11 +969,68 @@ static void writeSlot(char* page, int n, int key, const std::string& value)
   memcpy(ptr, &key, sizeof(int));
 
   // store the value. 
-  if ((int)value.size() >= RecordFile::MAX_VALUE_LENGTH) {
-    // when the string is longer than MAX_VALUE_LENGTH, truncate it.
-    memcpy(ptr + sizeof(int), value.c_str(), RecordFile::MAX_VALUE_LENGTH -1);
-    *(ptr + sizeof(int) + RecordFile::MAX_VALUE_LENGTH - 1) = 0;
-  } else {
-    strcpy(ptr + sizeof(int), value.c_str());
-  }
+  // when the string is longer than MAX_VALUE_LENGTH, truncate it.
+  if (length >= RecordFile::MAX_VALUE_LENGTH) length = RecordFile::MAX_VALUE_LENGTH - 1;
+  memcpy(ptr + sizeof(int), value, length);
+  *(ptr + sizeof(int) + length) = 0;
+}
+
+static int getInt(const char* p)
+{
+  int v;
+  memcpy(&v, p, sizeof(int));
+  return v;
+}
+
+static void setInt(char* p, int v)
+{
+  memcpy(p, &v, sizeof(int));
+}
+
+static void initSlottedPage(char* page, int size, int base)
+{
+  // no records yet. they will be stored from the end of the page
+  memset(page, 0, size);
+  setInt(page + sizeof(int), base);
+  setInt(page + 2 * sizeof(int), size);
+}
+
+static const char* slottedRecord(const char* page, int n)
+{
+  // the directory follows the header and holds the offset of each record
+  return page + getInt(page + SLOTTED_HEADER + n * sizeof(int));
+}
+
+static int getShort(const char* p)
+{
+  unsigned short v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static void setShort(char* p, int v)
+{
+  unsigned short w = v;
+  memcpy(p, &w, sizeof(w));
+}
+
+static const char* dictionaryValue(const char* page, int c)
+{
+  // the offsets of the values follow the keys and the codes
+  int count = getInt(page);
+  return page + getShort(page + DICTIONARY_HEADER + count * (sizeof(int) + 2) + c * 2);
+}
+
+static int entrySize(int length, int limit)
+{
+  // the length, then the bytes and a NUL, or the first overflow page
+  return sizeof(int) + ((length > limit) ? (int)sizeof(PageId) : length + 1);
+}
+
+static unsigned hashBytes(const char* value, int length)
+{
+  // FNV-1a
+  unsigned h = 2166136261u;
+  for (int i = 0; i < length; i++) h = (h ^ (unsigned char)value[i]) * 16777619u;
+  return h;
 }
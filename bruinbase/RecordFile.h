@@ -10,7 +10,9 @@
 #ifndef RECORDFILE_H
 #define RECORDFILE_H
 
+#include <deque>
 #include <string>
+#include <vector>
 #include "PageFile.h"
 
 /**
@@ -26,10 +28,6 @@ typedef struct {
 // helper functions for RecordId
 // 
 
-// RecordId iterators
-RecordId& operator++ (RecordId& rid);
-RecordId  operator++ (RecordId& rid, int);
-
 // RecordId comparators
 bool operator> (const RecordId& r1, const RecordId& r2);
 bool operator< (const RecordId& r1, const RecordId& r2);
@@ -39,18 +37,44 @@ bool operator== (const RecordId& r1, const RecordId& r2);
 bool operator!= (const RecordId& r1, const RecordId& r2);
 
 /**
- * read/write a record to a file
+ * read/write a record to a file.
+ * a file stores its records in one of three page layouts, kept as the
+ * format number of the PageFile:
+ * - FIXED: the first four bytes of a page hold # records in the page,
+ *   followed by slots of SLOT_SIZE bytes. values are truncated to
+ *   MAX_VALUE_LENGTH-1 bytes. files written before SLOTTED have it.
+ * - SLOTTED: a page has a header (# records, # records in the earlier
+ *   pages, the start of the record area), followed by a directory with
+ *   the offset of each record. the records are stored from the end of
+ *   the page toward the directory and take only as much space as their
+ *   value. a record is the key, the value length and the value with a
+ *   NUL; a value longer than a quarter of a page is kept in a chain of
+ *   overflow pages, and the record holds the first page of the chain.
+ *   overflow pages are stored among the record pages, which skip them.
+ * - DICTIONARY: like SLOTTED, but a page keeps each distinct value once.
+ *   after the header (# records, # records in the earlier pages,
+ *   # distinct values) come the keys of the records, the 2-byte code of
+ *   the value of each record, the offset of the value of each code, and
+ *   the values (length and bytes with a NUL, or length and the first
+ *   overflow page). the codes let a condition on the value be checked
+ *   once per distinct value of a page.
+ * new files are created with the default layout, SLOTTED unless changed
+ * with setDefaultLayout().
  */
 class RecordFile {
  public:
 
-  // maximum length of the value field
+  // the page layouts of a file
+  enum Layout { FIXED = 0, SLOTTED = 1, DICTIONARY = 2 };
+
+  // maximum length of the value field in the FIXED layout
   static const int MAX_VALUE_LENGTH = 100;  
 
-  // number of record slots per page
-  static const int RECORDS_PER_PAGE = (PageFile::PAGE_SIZE - sizeof(int))/ (sizeof(int) + MAX_VALUE_LENGTH);  
-    // Note that we subtract sizeof(int) from PAGE_SIZE because the first
-    // four bytes in the page is used to store # records in the page.
+  // size of a record slot in a page of the FIXED layout
+  static const int SLOT_SIZE = sizeof(int) + MAX_VALUE_LENGTH;
+
+  // pages readMany() asks for at once
+  static const int READ_AHEAD_PAGES = 64;
 
   RecordFile();
   RecordFile(const std::string& filename, char mode);
@@ -65,11 +89,20 @@ class RecordFile {
   RC open(const std::string& filename, char mode);
 
   /**
-   * close the file.
+   * close the file. the records appended since the last flush() are
+   * written first.
    * @return error code. 0 if no error
    */
   RC close();
 
+  /**
+   * write the last page of the file, if append() has added records to
+   * it since it was last written. a page that append() fills up is
+   * written right away, so only the last page may be pending.
+   * @return error code. 0 if no error
+   */
+  RC flush();
+
   /**
    * read a record from the file. note that every record is a (key, value) pair.
    * @param rid[IN] the id of the record to read
@@ -79,8 +112,31 @@ class RecordFile {
    */
   RC read(const RecordId& rid, int& key, std::string& value) const;
 
+  /**
+   * read only the key of a record. the value is not copied.
+   * @param rid[IN] the id of the record to read
+   * @param key[OUT] the record key
+   * @return error code. 0 if no error
+   */
+  RC readKey(const RecordId& rid, int& key) const;
+
+  /**
+   * read a batch of records. the records are visited in page order, so
+   * every page is read once however many of its records are requested
+   * and however they are ordered in rids. the i-th record is returned
+   * in keys[i] and values[i].
+   * @param rids[IN] the ids of the records to read
+   * @param count[IN] the number of records to read
+   * @param keys[OUT] the record keys
+   * @param values[OUT] the record values
+   * @return error code. 0 if no error
+   */
+  RC readMany(const RecordId* rids, int count, int* keys, std::string* values) const;
+
   /**
    * append a new record at the end of the file.
+   * the record is put in the last page in memory; the page is written
+   * once, when it is full or at flush() or close().
    * note that RecordFile does not have write() function.
    * append is the only way to write a record to a RecordFile.
    * @param key[IN] the record key
@@ -90,15 +146,246 @@ class RecordFile {
    */
   RC append(int key, const std::string& value, RecordId& rid);
 
+  /**
+   * append a new record whose value is not NUL-terminated.
+   * @param key[IN] the record key
+   * @param value[IN] the record value
+   * @param length[IN] the length of the value
+   * @param rid[OUT] the location of the stored record
+   * @return error code. 0 if no error
+   */
+  RC append(int key, const char* value, int length, RecordId& rid);
+
+  /**
+   * append a batch of records at the end of the file. the pages are
+   * filled in memory and each is written once.
+   * the records get consecutive ids: the i-th record is stored at
+   * first advanced i times with next(), and the last one is at
+   * endRid()-1.
+   * @param keys[IN] the record keys
+   * @param values[IN] the record values, not NUL-terminated
+   * @param lengths[IN] the lengths of the values
+   * @param count[IN] the number of records
+   * @param first[OUT] the location of the first record
+   * @return error code. 0 if no error
+   */
+  RC appendMany(const int* keys, const char* const* values, const int* lengths,
+                int count, RecordId& first);
+
   /**
    * note the +1 part. The rid of the last record is endRid()-1.
    * @return (last record id + 1) of the RecordFile
    */
   const RecordId& endRid() const;
 
+  /**
+   * in the FIXED layout, records are only appended, so every page but
+   * the last one is full and the number of records follows from
+   * endRid(). in the SLOTTED and DICTIONARY layouts, a page holds as
+   * many records as fit, and its header counts the records in the
+   * earlier pages; the number is that count of the last page plus the
+   * records in it. no page is read.
+   * @return the number of records in the file
+   */
+  int getRecordCount() const;
+
+  /**
+   * move a record id to the next record slot.
+   * when the end of a page is reached, rid moves to the first slot of the
+   * next page. (RecordIds cannot be incremented without the RecordFile,
+   * because the number of slots depends on the page size of the file,
+   * and in the SLOTTED layout on the records of the page.)
+   * @param rid[IN/OUT] the record id to advance
+   */
+  void next(RecordId& rid) const;
+
+  /**
+   * number of record slots per page.
+   * Note that we subtract sizeof(int) from the page size because the first
+   * four bytes in the page is used to store # records in the page.
+   * in the SLOTTED layout, this is the most records a page can hold,
+   * i.e., the number of records with empty values that fit.
+   * @return the # of records that fit in a page of the file
+   */
+  int getRecordsPerPage() const;
+
+  /**
+   * @return the page layout of the file
+   */
+  Layout getLayout() const { return layout; }
+
+  /**
+   * choose the page layout of the files created from now on.
+   * @param l[IN] SLOTTED or DICTIONARY
+   * @return error code. 0 if no error
+   */
+  static RC setDefaultLayout(Layout l);
+
+  /**
+   * @return the page layout of the files created from now on
+   */
+  static Layout getDefaultLayout() { return defaultLayout; }
+
+  /**
+   * @return the page size of the file in bytes
+   */
+  int getPageSize() const { return pf.getPageSize(); }
+
+  /**
+   * @return the # of pages written to the file, overflow pages included
+   */
+  PageId getPageCount() const { return pf.endPid(); }
+
+  /**
+   * @return the PageFile of the records
+   */
+  const PageFile& getPageFile() const { return pf; }
+
  private:
+  friend class RecordScan;
+
+  // pin the page pid, or point into the last page if append() has not
+  // written it yet. data is valid while page is pinned or until the
+  // next append()
+  RC fetchPage(PageId pid, PageGuard& page, const char*& data) const;
+
+  // read the record in slot sid of a page of the file
+  RC readRecord(const char* page, int sid, int& key, std::string& value) const;
+
+  // read a value kept in overflow pages
+  RC readOverflow(PageId pid, int length, std::string& value) const;
+
+  // point to a SLOTTED or DICTIONARY value that starts with its length.
+  // a long value is read into a new string of longs
+  RC resolveValue(const char* v, const char*& value, std::deque<std::string>& longs) const;
+
+  // the appends of each layout
+  RC appendFixed(const int* keys, const char* const* values, const int* lengths,
+                 int count, RecordId& first);
+  RC appendSlotted(const int* keys, const char* const* values, const int* lengths,
+                   int count, RecordId& first);
+  RC appendDictionary(const int* keys, const char* const* values, const int* lengths,
+                      int count, RecordId& first);
+
+  // read the last page of a DICTIONARY file into dict, or start an
+  // empty one if erid.sid is 0
+  RC loadDictionary();
+
+  // write the image of dict into tail
+  void packDictionary();
+
+  // the code of a value in dict. -1 if it is not there
+  int findCode(const char* value, int length) const;
+
+  // add a new value to dict
+  // @return the code of the value
+  int addValue(const char* value, int length, PageId chain);
+
+  // write a value to a chain of new overflow pages
+  RC writeOverflow(const char* value, int length, PageId& first);
+
+  // # records in the page pid. -1 for an overflow page
+  int countOf(PageId pid) const;
+
+  // the longest value a SLOTTED record keeps in its page
+  int inlineLimit() const { return pf.getPageSize() / 4 - 3 * (int)sizeof(int) - 1; }
+
   PageFile pf;     // the PageFile used to store the records
   RecordId erid;   // the last record id of the file + 1
+  Layout   layout; // the page layout of the file
+
+  std::vector<char> tail;  // the last page, filled by append()
+  PageId   tailPid;        // the page in tail. -1 if none
+  bool     dirty;          // tail has records not written yet
+
+  // SLOTTED layout
+  int      base;           // # records before the page erid.pid
+  PageId   nextPid;        // the next unused page id
+  mutable PageId countPid; // the page last looked up by next()
+  mutable int    countVal; //   and its # records
+
+  // the last page of a DICTIONARY file, while append() fills it.
+  // tail holds its image
+  struct Dictionary {
+    std::vector<int> keys;            // the keys of the records
+    std::vector<int> codes;           // the code of each record
+    std::vector<std::string> values;  // the distinct values, by code
+    std::vector<PageId> chains;       // the overflow chain of a long
+                                      // value. -1 if in the page
+    std::vector<int> table;           // hash table of the codes
+    int bytes;                        // the size of the image
+  };
+  Dictionary dict;
+
+  static Layout defaultLayout;  // the layout of new files
+};
+
+/**
+ * A scan over all records of a RecordFile, a batch of pages at a time.
+ * The keys of a batch are copied into an array, so conditions on the key
+ * can be checked for the whole batch at once, and the values are handed
+ * out as pointers into the pinned pages. A value is copied only by the
+ * caller, for the records it keeps.
+ */
+class RecordScan {
+ public:
+  static const int BATCH_SIZE = 1024;  // a good batch size for nextBatch()
+  static const int MAX_PAGES = 128;    // pages one batch may keep pinned
+
+  RecordScan();
+
+  /**
+   * start the scan at the first record of a file.
+   * @param file[IN] the open file to scan
+   * @return error code. 0 if no error
+   */
+  RC open(const RecordFile& file);
+
+  /**
+   * return the next records of the scan. the pages of the previous batch
+   * are unpinned, so its value pointers become invalid. the values are
+   * NUL-terminated.
+   * @param keys[OUT] the keys of the records
+   * @param values[OUT] the values of the records, valid until the next
+   *   call to nextBatch() or close()
+   * @param max[IN] the capacity of keys and values
+   * @param count[OUT] the number of records returned
+   * @return error code. RC_END_OF_INPUT after the last record
+   */
+  RC nextBatch(int* keys, const char** values, int max, int& count);
+
+  /**
+   * like nextBatch(), and also number the values of the batch, so that
+   * a condition on the value can be checked once per number instead of
+   * once per record. records with the same code have the same value.
+   * in the DICTIONARY layout, the records of a page with the same value
+   * share a code. otherwise every record gets its own.
+   * @param keys[OUT] the keys of the records
+   * @param values[OUT] the values of the records
+   * @param codes[OUT] the code of each value, below codeCount
+   * @param max[IN] the capacity of keys, values and codes
+   * @param count[OUT] the number of records returned
+   * @param codeCount[OUT] the number of codes used. at most count
+   * @return error code. RC_END_OF_INPUT after the last record
+   */
+  RC nextBatch(int* keys, const char** values, int* codes, int max, int& count, int& codeCount);
+
+  /**
+   * unpin the pages of the last batch.
+   */
+  void close();
+
+ private:
+  RecordScan(const RecordScan&);
+  RecordScan& operator=(const RecordScan&);
+
+  const RecordFile* file;     // the scanned file
+  RecordId cursor;            // the next record to return
+  PageGuard pages[MAX_PAGES]; // the pages of the last batch, pinned
+  std::deque<std::string> longValues;  // the values of the last batch
+                                       // read from overflow pages
+  std::vector<int> remap;     // the batch code of each code of a page
+  std::vector<const char*> resolved;  // the value of each code of a page
 };
 
 #endif // RECORDFILE_H
@@ -8,12 +8,19 @@
  */
 
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <cmath>
+#include <algorithm>
 #include <iostream>
-#include <fstream>
 #include <string>
 #include "Bruinbase.h"
 #include "SqlEngine.h"
 #include "BTreeIndex.h"
+#include "TableStats.h"
+#include "Predicate.h"
+#include "LoadPipeline.h"
 
 using namespace std;
 
@@ -34,33 +41,172 @@ RC SqlEngine::run(FILE* commandline)
   return 0;
 }
 
-bool SqlEngine::checkValidCond(SelCond smaller, SelCond larger, SelCond equal) {
-    bool isValid = true;
-    if (atoi(equal.value) == -1) {
-        return isValid;
+// # of tuples the index path reads from the table at once. the larger
+// the batch, the more of its tuples share a page that is read only once
+static const int FETCH_BATCH = 65536;
+
+// read the tuples of rids in one pass over their pages, keep those whose
+// value meets the conditions and print them in the order of rids
+static RC fetchTuples(const RecordFile& rf, int attr, const Predicate& pred,
+                      const vector<RecordId>& rids, int& count)
+{
+  RC     rc;
+  int    n = rids.size();
+  vector<int>    keys(n);
+  vector<string> values(n);
+
+  if ((rc = rf.readMany(&rids[0], n, &keys[0], &values[0])) < 0) {
+    fprintf(stderr, "Error: while reading a tuple from the table\n");
+    return rc;
+  }
+
+  for (int i = 0; i < n; i++) {
+    if (!pred.matchValue(values[i].c_str())) continue;
+    count++;
+    switch (attr) {
+    case 1:
+      fprintf(stdout, "%d\n", keys[i]);
+      break;
+    case 2:
+      fprintf(stdout, "%s\n", values[i].c_str());
+      break;
+    case 3:
+      fprintf(stdout, "%d '%s'\n", keys[i], values[i].c_str());
+      break;
     }
-    // check if smaller, larger, equal each has value
-    if (atoi(larger.value) != INT_MAX) {
-        isValid = atoi(equal.value) <= atoi(larger.value);
+  }
+  return 0;
+}
+
+RC SqlEngine::countByIndex(BTreeIndex& idx, const Predicate& pred, int& count)
+{
+  RC  rc;
+  int n;
+  const vector<int>& excluded = pred.getExcludedKeys();
+
+  count = 0;
+  if (pred.hasValueTerms()) return RC_INVALID_ATTRIBUTE;
+  if (pred.isEmpty()) return 0;
+  if ((rc = idx.countRange(pred.getLow(), pred.getHigh(), count)) < 0) return rc;
+
+  // take away the keys excluded with <>
+  for (unsigned i = 0; i < excluded.size(); i++) {
+    if ((rc = idx.countRange(excluded[i], excluded[i], n)) < 0) return rc;
+    count -= n;
+  }
+  return 0;
+}
+
+// the fraction of the tuples that meet the conditions on value,
+// estimated from the distinct count of the values. a range condition
+// on a string is assumed to keep a third of the tuples
+static double valueSelectivity(const TableStats& stats, const vector<SelCond>& cond)
+{
+  double distinct = stats.getDistinctValues();
+  double sel = 1;
+
+  if (distinct < 1) distinct = 1;
+  for (unsigned i = 0; i < cond.size(); i++) {
+    if (cond[i].attr != 2) continue;
+    switch (cond[i].comp) {
+    case SelCond::EQ: sel *= 1 / distinct; break;
+    case SelCond::NE: sel *= 1 - 1 / distinct; break;
+    default:          sel *= 1.0 / 3; break;
     }
-    
-    if (atoi(smaller.value) != -1) {
-        isValid = atoi(equal.value) >= atoi(smaller.value);
+  }
+  return sel;
+}
+
+// tell how a table scan reads the pages of the table when scans are
+// asked to use O_DIRECT
+static void printScanIO(const PageFile& pf)
+{
+  if (pf.canReadDirect()) {
+    fprintf(stderr, "  -- scan: O_DIRECT reads\n");
+  } else if (pf.getDirectAlign() > 0) {
+    fprintf(stderr, "  -- scan: page cache reads. %d-byte pages are not aligned to the "
+            "%d-byte blocks O_DIRECT needs\n", pf.getPageSize(), pf.getDirectAlign());
+  } else {
+    fprintf(stderr, "  -- scan: page cache reads. the table is mapped or its file system "
+            "refuses O_DIRECT\n");
+  }
+}
+
+bool SqlEngine::chooseIndex(int attr, const string& table, const RecordFile& rf,
+                            const BTreeIndex* idx, const vector<SelCond>& cond,
+                            const Predicate& pred)
+{
+  const TableStats* stats = TableStats::get(table);
+  long long lo = pred.getLow();   // the key range the conditions allow.
+  long long hi = pred.getHigh();  // <> excludes too few keys to narrow it
+  double keyRows = -1;            // tuples in the key range
+  double rows = -1;               // tuples that meet all conditions
+
+  if (pred.isEmpty()) lo = hi = 0;
+
+  // the table statistics cover the key range and the conditions on value
+  if (stats != NULL) {
+    keyRows = stats->estimateKeyRange(lo, hi);
+    rows = keyRows * valueSelectivity(*stats, cond);
+  }
+
+  double tablePages = rf.endRid().pid + (rf.endRid().sid > 0 ? 1 : 0);
+
+  if (idx == NULL) {
+    if (rows >= 0) {
+      fprintf(stderr, "  -- plan: table scan, est. %.0f rows, %.0f pages\n", rows, tablePages);
+    } else {
+      fprintf(stderr, "  -- plan: table scan, %.0f pages\n", tablePages);
     }
-    return isValid;
+    return false;
+  }
+
+  // without statistics, the index is used for conditions on the key
+  // alone, as before they were kept
+  if (keyRows < 0) return !pred.hasValueTerms();
+
+  // the index reads its nodes and, unless only the key is needed, the
+  // pages of the tuples in the key range. the tuples are read in page
+  // order, so a page is read once for all of its matches. with p pages,
+  // the number of distinct pages of m tuples is about p * (1 - (1 - 1/p)^m)
+  double indexPages = idx->estimateNodes(keyRows);
+  if ((attr == 2 || attr == 3 || pred.hasValueTerms()) && tablePages > 0) {
+    indexPages += tablePages * (1 - pow(1 - 1 / tablePages, keyRows));
+  }
+
+  bool useIndex = (indexPages <= tablePages);
+  fprintf(stderr, "  -- plan: %s, est. %.0f rows, %.0f pages (%s: %.0f pages)\n",
+          useIndex ? "index scan" : "table scan", rows,
+          useIndex ? indexPages : tablePages,
+          useIndex ? "table scan" : "index scan",
+          useIndex ? tablePages : indexPages);
+  return useIndex;
 }
+
 RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
 {
     RecordFile rf;   // RecordFile containing the table
-    RecordId   rid;  // record cursor for table scanning
     BTreeIndex idx;  // index for searching in the table
-    IndexCursor cursor;
+    IndexScan  scan; // leaf scan of the index
+    Predicate  pred; // the conditions, compiled once for all tuples
+    bool       indexOpen;
+    bool       useIndex;
+    bool       needValue;  // the value is printed or compared
+    int        batchKeys[IndexScan::BATCH_SIZE];
+    RecordId   batchRids[IndexScan::BATCH_SIZE];
+    int        batchSel[IndexScan::BATCH_SIZE];
+    int        batchCount;
+    vector<RecordId> fetchRids;  // matches whose tuples are not read yet
+    RecordScan rscan;            // page batch scan of the table
+    int        scanKeys[RecordScan::BATCH_SIZE];
+    const char* scanValues[RecordScan::BATCH_SIZE];
+    int        scanCodes[RecordScan::BATCH_SIZE];
+    signed char scanMatch[RecordScan::BATCH_SIZE];  // by code. -1 if not checked
+    int        scanSel[RecordScan::BATCH_SIZE];
+    int        codeCount;
     
     RC     rc;
-    int    key;
-    string value;
     int    count;
-    int    diff=1;
     
     // open the table file
     if ((rc = rf.open(table + ".tbl", 'r')) < 0) {
@@ -69,274 +215,124 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
     }
     count = 0;
     
-    if (idx.open(table + ".idx", 'r')==0) {
-        
-        vector<SelCond> usefulCond;
-        SelCond smaller; //initialize with 0
-        SelCond larger; // initialize with MAX_INT
-        SelCond equal; //initialize -1
-        //initialize
-
-        smaller.value = "-1";
-        larger.value = "2147483647";
-        equal.value = "-1";
-        if (cond.size() == 0)
-        {
-            idx.locate(0, cursor);
-            goto condition_check;
-        }
-        
-        // get the boundary value from the query condition
-        for(int i = 0; i < cond.size(); i ++ ){
-            //        if(i < 2)
-            //        {
-            //            if(cond[i].comp == SelCond::GT|| cond[i].comp == SelCond::GE)
-            //                // set smaller to cond[0]
-            //                smaller = cond[i];
-            //            if (cond[i].comp == SelCond::LT|| cond[i].comp == SelCond::LE)
-            //                // set larger to cond[0]
-            //                larger = cond[i];
-            //        }
-            if (cond[i].comp == SelCond::EQ) {
-                if (atoi(equal.value) != -1) {
-                    fprintf(stderr, "Error: Invalid query\n");
-                    return RC_NO_SUCH_RECORD;
-                }
-                equal = cond[i];
-            }
-            if(atoi(cond[i].value) > atoi(larger.value)){
-                // check cond[i].comp is smaller or not
-                if(cond[i].comp == SelCond::GT || cond[i].comp == SelCond::GE){
-                    // query is wrong
-                    fprintf(stderr, "Error: Invalid query\n");
-                    return RC_NO_SUCH_RECORD;
-                }
-            }
-            if(atoi(cond[i].value) < atoi(smaller.value)){
-                // check cond[i].comp is larger or not
-                if(cond[i].comp == SelCond::LT || cond[i].comp == SelCond::LE){
-                    // query is wrong
-                    fprintf(stderr, "Error: Invalid query\n");
-                    return RC_NO_SUCH_RECORD;
-                }
-            }
-            if(atoi(cond[i].value) < atoi(larger.value)){
-                // check cond[i].comp is smaller or not
-                if(cond[i].comp == SelCond::LT || cond[i].comp == SelCond::LE)
-                    // update larger
-                    larger = cond[i];
-            }
-            if(atoi(cond[i].value) > atoi(smaller.value)){
-                // check cond[i].comp is larger or not
-                if(cond[i].comp == SelCond::GT || cond[i].comp == SelCond::GE)
-                    // update smaller
-                    smaller = cond[i];
-            }
-            bool isValid = checkValidCond(smaller,larger,equal);
-            if (!isValid) {
-                fprintf(stderr, "Error: Invalid query\n");
-                return RC_NO_SUCH_RECORD;
-            }
-        }
-        if (atoi(equal.value) != -1) {   //if condition satisfies when there is no condition in query
-            usefulCond.push_back(equal);
-        } else {
-            if (cond.size() == 1) {
-                if(cond[0].comp == SelCond::GT || cond[0].comp == SelCond::GE)
-                    usefulCond.push_back(smaller);
-                else if(cond[0].comp == SelCond::LT || cond[0].comp == SelCond::LE)
-                    usefulCond.push_back(larger);
-            }
-            else {
-                usefulCond.push_back(smaller);
-                usefulCond.push_back(larger);
-            }
-        }
+    indexOpen = (idx.open(table + ".idx", 'r') == 0);
 
-        
-        if (usefulCond.size() == 1)
-        {
-            switch (usefulCond[0].comp) {
-                case SelCond::EQ:
-                    idx.locate(atoi(equal.value), cursor);
-                    break;
-                case SelCond::NE:
-                    idx.locate(0, cursor);
-                    break;
-                case SelCond::GT:
-                    idx.locate(atoi(smaller.value), cursor);
-                    break;
-                case SelCond::GE:
-                    idx.locate(atoi(smaller.value), cursor);
-                    break;
-                case SelCond::LT:
-                    idx.locate(0, cursor);
-                    break;
-                case SelCond::LE:
-                    idx.locate(0, cursor);
-                    break;
-            }
+    pred.compile(cond);
+    needValue = (attr == 2 || attr == 3 || pred.hasValueTerms());
+
+    // count(*) is answered from the entry counts kept in the index nodes,
+    // or, without an index or conditions, from the size of the table
+    if (attr == 4) {
+        if (indexOpen && countByIndex(idx, pred, count) == 0) {
+            fprintf(stderr, "  -- plan: index count\n");
+            goto end_find;
         }
-        
-        else if(usefulCond.size() > 1)
-        {
-            if (usefulCond[0].comp == SelCond::EQ || usefulCond[1].comp == SelCond::EQ) {
-                idx.locate(atoi(equal.value), cursor);
-            }
-            else
-                idx.locate(atoi(smaller.value), cursor);
+        if (cond.empty()) {
+            count = rf.getRecordCount();
+            fprintf(stderr, "  -- plan: record count\n");
+            goto end_find;
         }
-    condition_check:
-        while ((idx.readForward(cursor, key, rid)) == 0) {
-            
-            //printf("cursor.eid = %d\n", cursor.eid);
-            //printf("key = %d\n", key);
-            // check the conditions on the tuple
-            for (unsigned i = 0; i < usefulCond.size(); i++) {
-                // compute the difference between the tuple value and the condition value
-                //switch (usefulCond[i].attr) {
-                    //case 1:
-                        //printf("keyTofind = %d\n", atoi(cond[i].value));
-                        diff = key - atoi(usefulCond[i].value);
-                        //printf("diff = %d\n", diff);
-                        //break;
-                    //case 2:
-                        //diff = strcmp(value.c_str(), usefulCond[i].value);
-                        //break;
-                //}
-                
-                //cout<<"comparision = "<<cond[i].comp<<endl;
-                // check the condition
-                switch (usefulCond[i].comp) {
-                    case SelCond::EQ:
-                        if (diff != 0) {
-                            if (cond[i].attr == 1) goto end_find;
-                            else continue;
-                        }
-                        goto find_match;
-                    case SelCond::NE:
-                        if (diff == 0) continue;
-                        break;
-                    case SelCond::GT:
-                        //printf("diff = %d\n", diff);
-                        if (diff <= 0) continue;
-                        //printf("key = %d\n", key);
-                        break;
-                    case SelCond::LT:
-                        if (diff >= 0) {
-                            if (usefulCond[i].attr == 1) goto end_find;
-                            else continue;
-                        }
-                        break;
-                    case SelCond::GE:
-                        if (diff < 0) continue;
-                        break;
-                    case SelCond::LE:
-                        if (diff > 0) {
-                            if (usefulCond[i].attr == 1) goto end_find;
-                            else continue;
-                        }
-                        break;
+    }
+
+    // use the index only if it is cheaper than scanning the table
+    useIndex = chooseIndex(attr, table, rf, indexOpen ? &idx : NULL, cond, pred);
+
+    // no tuple can meet conditions that contradict each other
+    if (pred.isEmpty()) goto end_find;
+
+    if (useIndex) {
+        // the scan returns the entries of a leaf in one batch,
+        // so every leaf page is read once. no leaf past the high end
+        // of the range is read ahead
+        int high = pred.getHigh() < INT_MAX ? (int)pred.getHigh() : INT_MAX;
+        if ((rc = scan.open(idx, (int)pred.getLow(), high)) < 0) goto exit_select;
+        while (scan.nextBatch(batchKeys, batchRids, IndexScan::BATCH_SIZE, batchCount) == 0) {
+            int n = pred.filterKeys(batchKeys, batchCount, batchSel);
+            for (int i = 0; i < n; i++) {
+                int b = batchSel[i];
+                if (!needValue) {
+                    count++;
+                    if (attr == 1) fprintf(stdout, "%d\n", batchKeys[b]);
+                    continue;
                 }
-            }
-            //cout<<"diff = "<<diff<<endl;
-            //if (diff == 0) continue;
-            //cout<<"count = "<<count<<endl;
-        find_match:
-            count++;
-            switch (attr) {
-                case 1:  // SELECT key
-                    fprintf(stdout, "%d\n", key);
-                    break;
-                case 2:  // SELECT value
-                    // read the tuple
-                    if ((rc = rf.read(rid, key, value)) < 0) {
-                        goto exit_select;
-                    }
-                    fprintf(stdout, "%s\n", value.c_str());
-                    break;
-                case 3:  // SELECT *
-                    // read the tuple
-                    if ((rc = rf.read(rid, key, value)) < 0) {
+
+                // the tuples are read in batches, page by page
+                fetchRids.push_back(batchRids[b]);
+                if (fetchRids.size() == FETCH_BATCH) {
+                    if ((rc = fetchTuples(rf, attr, pred, fetchRids, count)) < 0) {
                         goto exit_select;
                     }
-                    fprintf(stdout, "%d '%s'\n", key, value.c_str());
-                    break;
+                    fetchRids.clear();
+                }
             }
+
+            // the keys come in order, so none after this batch can match
+            if (batchCount > 0 && batchKeys[batchCount - 1] > pred.getHigh()) break;
         }
     }
     
     
     else{
-        // scan the table file from the beginning
-        rid.pid = rid.sid = 0;
-        
-        while (rid < rf.endRid()) {
-            // read the tuple
-            if ((rc = rf.read(rid, key, value)) < 0) {
-                fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
-                goto exit_select;
+        // scan the table file from the beginning, a batch of pages at a
+        // time. the keys of a batch are checked at once, and only the
+        // values of the matching tuples are looked at, once per value
+        // code, so once per distinct value of a dictionary page
+        bool direct = rf.getPageFile().canReadDirect();
+        if (PageFile::getDirectIO()) printScanIO(rf.getPageFile());
+        rscan.open(rf);
+        while ((rc = rscan.nextBatch(scanKeys, scanValues, scanCodes, RecordScan::BATCH_SIZE,
+                                     batchCount, codeCount)) == 0) {
+            int n = pred.filterKeys(scanKeys, batchCount, scanSel);
+            if (attr == 4 && !pred.hasValueTerms()) {
+                count += n;
+                continue;
             }
-            
-            // check the conditions on the tuple
-            for (unsigned i = 0; i < cond.size(); i++) {
-                // compute the difference between the tuple value and the condition value
-                switch (cond[i].attr) {
-                    case 1:
-                        diff = key - atoi(cond[i].value);
-                        break;
-                    case 2:
-                        diff = strcmp(value.c_str(), cond[i].value);
-                        break;
+
+            if (pred.hasValueTerms()) memset(scanMatch, -1, codeCount);
+            for (int i = 0; i < n; i++) {
+                int b = scanSel[i];
+                if (pred.hasValueTerms()) {
+                    signed char& match = scanMatch[scanCodes[b]];
+                    if (match < 0) match = pred.matchValue(scanValues[b]);
+                    if (!match) continue;
                 }
-                
-                // skip the tuple if any condition is not met
-                switch (cond[i].comp) {
-                    case SelCond::EQ:
-                        if (diff != 0) goto next_tuple;
-                        break;
-                    case SelCond::NE:
-                        if (diff == 0) goto next_tuple;
-                        break;
-                    case SelCond::GT:
-                        if (diff <= 0) goto next_tuple;
-                        break;
-                    case SelCond::LT:
-                        if (diff >= 0) goto next_tuple;
+
+                // the condition is met for the tuple.
+                // increase matching tuple counter
+                count++;
+
+                // print the tuple
+                switch (attr) {
+                    case 1:  // SELECT key
+                        fprintf(stdout, "%d\n", scanKeys[b]);
                         break;
-                    case SelCond::GE:
-                        if (diff < 0) goto next_tuple;
+                    case 2:  // SELECT value
+                        fprintf(stdout, "%s\n", scanValues[b]);
                         break;
-                    case SelCond::LE:
-                        if (diff > 0) goto next_tuple;
+                    case 3:  // SELECT *
+                        fprintf(stdout, "%d '%s'\n", scanKeys[b], scanValues[b]);
                         break;
                 }
             }
-            
-            // the condition is met for the tuple.
-            // increase matching tuple counter
-            count++;
-            
-            // print the tuple
-            switch (attr) {
-                case 1:  // SELECT key
-                    fprintf(stdout, "%d\n", key);
-                    break;
-                case 2:  // SELECT value
-                    fprintf(stdout, "%s\n", value.c_str());
-                    break;
-                case 3:  // SELECT *
-                    fprintf(stdout, "%d '%s'\n", key, value.c_str());
-                    break;
-            }
-            
-            // move to the next tuple
-        next_tuple:
-            ++rid;
+        }
+        rscan.close();
+        if (direct && !rf.getPageFile().canReadDirect()) {
+            fprintf(stderr, "  -- scan: O_DIRECT reads failed, read the rest through the page cache\n");
+        }
+        if (rc != RC_END_OF_INPUT) {
+            fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
+            goto exit_select;
         }
     }
     
 end_find:
+    // print the tuples still waiting to be read
+    if (!fetchRids.empty()) {
+        if ((rc = fetchTuples(rf, attr, pred, fetchRids, count)) < 0) {
+            goto exit_select;
+        }
+    }
+
     // print matching tuple count if "select count(*)"
     if (attr == 4) {
         fprintf(stdout, "%d\n", count);
@@ -345,90 +341,98 @@ end_find:
     
     // close the table file and return
 exit_select:
+    if (indexOpen) idx.close();
     rf.close();
     return rc;
 }
 
-RC SqlEngine::load(const string& table, const string& loadfile, bool index)
+RC SqlEngine::load(const string& table, const string& loadfile, bool index, int& rows)
 {
-  /* your code here */
-    RecordFile* rf=new RecordFile(table + ".tbl", 'w');
-    ifstream in(loadfile.c_str());
-    if(!in.is_open())
-    {
-        cout << "Error opening file"<<endl;
-        exit(1);
-    }
-    string buffer;
-    BTreeIndex btnode;
-    while (in.good() && getline(in,buffer)) {
-        int key;
-        string value;
-        RecordId id;
-        IndexCursor cursor;
-        
-        parseLoadLine(buffer,key,value);
-        //write the key,value pair into Recordfile
-        rf->append(key,value,id);
-        if(index == true) {
-            btnode.open(table + ".idx",'w');
-            btnode.insert(key,id);
-            btnode.close();
-          //look at what RecordId is returned from RecordFile::append()
-          //fprintf(stdout, "RecordId: pid = %d, sid = %d\n", id.pid, id.sid);
-          //fprintf(stdout, "key: %d\n", key);
-        }
-    }
-    /*BTreeIndex btindex;
-    int key;
-    IndexCursor cursor;
-    btindex.open(table+ ".index",'w');
-    for (key=1; key<=5; key++) {
-        btindex.locate(key,cursor);
-        printf("SqlEngine::load: key=%d\tcursor.pid=%d\tcursor.eid=%d\n",key,cursor.pid,cursor.eid);
-    }*/
-    rf->close();
-    
-  return 0;
-}
+  RecordFile  rf;      // RecordFile the tuples are appended to
+  BTreeIndex  idx;     // the index writer, open for the whole load
+  IndexSorter sorter;  // the index entries, loaded after the table
+  TableStats  stats;   // the statistics, continued from earlier loads
+  LoadPipeline in;     // the parsed tuples of the load file, in order
+  LoadPipeline::Batch* batch;
+  RecordId    rid;
+  string      value;
+  int         key;
+  RC          rc;
 
-RC SqlEngine::parseLoadLine(const string& line, int& key, string& value)
-{
-    const char *s;
-    char        c;
-    string::size_type loc;
-    
-    // ignore beginning white spaces
-    c = *(s = line.c_str());
-    while (c == ' ' || c == '\t') { c = *++s; }
+  rows = 0;
 
-    // get the integer key value
-    key = atoi(s);
+  // open the load file. its lines are parsed by the threads of the pipeline
+  if (in.open(loadfile) < 0) {
+    fprintf(stderr, "Error: cannot open load file %s\n", loadfile.c_str());
+    return RC_FILE_OPEN_FAILED;
+  }
 
-    // look for comma
-    s = strchr(s, ',');
-    if (s == NULL) { return RC_INVALID_FILE_FORMAT; }
+  // open the table file and the index file once for all tuples
+  if ((rc = rf.open(table + ".tbl", 'w')) < 0) {
+    fprintf(stderr, "Error: cannot open table %s\n", table.c_str());
+    return rc;
+  }
+  if (index && (rc = idx.open(table + ".idx", 'w')) < 0) {
+    fprintf(stderr, "Error: cannot open the index of table %s\n", table.c_str());
+    rf.close();
+    return rc;
+  }
 
-    // ignore white spaces
-    do { c = *++s; } while (c == ' ' || c == '\t');
-    
-    // if there is nothing left, set the value to empty string
-    if (c == 0) { 
-        value.erase();
-        return 0;
+  // the statistics continue those of the earlier loads into the table.
+  // a table loaded before the statistics were kept, or whose stat file
+  // does not describe it (e.g. the table was deleted and is loaded
+  // again), is read once to build them from scratch
+  if (stats.read(table) < 0 || rf.getRecordCount() == 0 ||
+      stats.getRowCount() != rf.getRecordCount()) {
+    stats = TableStats();
+    for (rid.pid = rid.sid = 0; rid < rf.endRid(); rf.next(rid)) {
+      if ((rc = rf.read(rid, key, value)) < 0) goto exit_load;
+      stats.add(key, value);
     }
+  }
 
-    // is the value field delimited by ' or "?
-    if (c == '\'' || c == '"') {
-        s++;
-    } else {
-        c = '\n';
+  // the tuples are appended by this thread alone, in the order of the
+  // file. a batch gets consecutive record ids. the values were hashed
+  // for the statistics by the parser threads
+  while ((rc = in.next(batch)) == 0) {
+    int n = batch->keys.size();
+    if (n > 0 && (rc = rf.appendMany(&batch->keys[0], &batch->values[0], &batch->lengths[0], n, rid)) < 0) {
+      fprintf(stderr, "Error: while appending a tuple to table %s\n", table.c_str());
+      in.release(batch);
+      goto exit_load;
+    }
+    for (int i = 0; i < n; i++, rf.next(rid)) {
+      key = batch->keys[i];
+      if (index && (rc = sorter.add(key, rid)) < 0) {
+        fprintf(stderr, "Error: while sorting the index entries of table %s\n", table.c_str());
+        in.release(batch);
+        goto exit_load;
+      }
+      stats.addHashed(key, batch->lengths[i], batch->hashes[i]);
+      rows++;
     }
+    in.release(batch);
+  }
+  if (rc != RC_END_OF_INPUT) {
+    fprintf(stderr, "Error: while reading load file %s\n", loadfile.c_str());
+    goto exit_load;
+  }
+  rc = 0;
 
-    // get the value string
-    value.assign(s);
-    loc = value.find(c, 0);
-    if (loc != string::npos) { value.erase(loc); }
+  if ((rc = stats.write(table)) < 0) {
+    fprintf(stderr, "Error: cannot write the statistics of table %s\n", table.c_str());
+  }
+
+  // build the index from the sorted entries
+  if (index) {
+    if ((rc = sorter.sort()) < 0 || (rc = idx.bulkLoad(sorter)) < 0) {
+      fprintf(stderr, "Error: while building the index of table %s\n", table.c_str());
+    }
+  }
 
-    return 0;
+  // close the files. the index root is written at close
+exit_load:
+  if (index) idx.close();
+  rf.close();
+  return rc;
 }
@@ -14,6 +14,9 @@
 #include "Bruinbase.h"
 #include "RecordFile.h"
 
+class BTreeIndex;
+class Predicate;
+
 /**
  * data structure to represent a condition in the WHERE clause
  */
@@ -51,25 +54,43 @@ class SqlEngine {
   static RC select(int attr, const std::string& table, const std::vector<SelCond>& conds);
 
   /**
-   * load a table from a load file.
+   * load a table from a load file. the format of the file is described
+   * at LoadPipeline::parseLine().
    * @param table[IN] the table name in the LOAD command
    * @param loadfile[IN] the file name of the load file
    * @param index[IN] true if "WITH INDEX" option was specified
+   * @param rows[OUT] the number of tuples loaded
    * @return error code. 0 if no error
    */
-  static RC load(const std::string& table, const std::string& loadfile, bool index);
+  static RC load(const std::string& table, const std::string& loadfile, bool index, int& rows);
 
+ private:
   /**
-   * parse a line from the load file into the (key, value) pair.
-   * @param line[IN] a line from a load file
-   * @param key[OUT] the key field of the tuple in the line
-   * @param value[OUT] the value field of the tuple in the line
-   * @return error code. 0 if no error
+   * count the tuples that meet the conditions from the entry counts kept
+   * in the index nodes, without reading the table.
+   * @param idx[IN] the open index of the table
+   * @param pred[IN] the compiled conditions in the WHERE clause
+   * @param count[OUT] the number of tuples that meet the conditions
+   * @return error code. RC_INVALID_ATTRIBUTE if a condition is on value
    */
-  static RC parseLoadLine(const std::string& line, int& key, std::string& value);
-    
+  static RC countByIndex(BTreeIndex& idx, const Predicate& pred, int& count);
 
-    static bool checkValidCond(SelCond smaller, SelCond larger, SelCond equal);
+  /**
+   * decide whether SELECT reads the table through its index or scans it.
+   * the pages each plan reads are estimated from the statistics of the
+   * table, the height of the index and the size of the table, and the
+   * plan is printed.
+   * @param attr[IN] attribute in the SELECT clause
+   * @param table[IN] the table name
+   * @param rf[IN] the table
+   * @param idx[IN] the open index of the table. NULL if there is none
+   * @param conds[IN] list of conditions in the WHERE clause
+   * @param pred[IN] the same conditions, compiled
+   * @return true if the index is cheaper
+   */
+  static bool chooseIndex(int attr, const std::string& table, const RecordFile& rf,
+                          const BTreeIndex* idx, const std::vector<SelCond>& conds,
+                          const Predicate& pred);
 };
 
 #endif /* SQLENGINE_H */
@@ -131,11 +131,16 @@
 #include <cstdio>
 #include <cstring>
 #include <sys/times.h>
+#include <sys/time.h>
+#include <unistd.h>
 #include <climits>
 #include <string>
 #include "Bruinbase.h"
 #include "SqlEngine.h" 
 #include "PageFile.h"
+#include "BufferPool.h"
+#include "BTreeIndex.h"
+#include "IoRing.h"
 
 int  sqllex(void);  
 void sqlerror(const char *str) { fprintf(stderr, "Error: %s\n", str); }
@@ -143,17 +148,58 @@ extern "C" { int  sqlwrap() { return 1; } }
 
 static void runSelect(int attr, const char* table, const std::vector<SelCond>& conds)
 {
-  struct tms tmsbuf;
-  clock_t btime, etime;
+  struct timeval btime, etime;
   int     bpagecnt, epagecnt;
-
-  btime = times(&tmsbuf);
+  int     bnodecnt, enodecnt;
+  int     bprefetch, eprefetch;
+  BufferPool::Stats bstats, estats;
+  IoRing::Stats bring, ering;
+  IoRing* ring = PageFile::getAsyncIO() ? IoRing::instance() : NULL;
+
+  memset(&bring, 0, sizeof(bring));
+  memset(&ering, 0, sizeof(ering));
+  // timed like loads, so that a short scan does not read as 0 seconds
+  gettimeofday(&btime, NULL);
   bpagecnt = PageFile::getPageReadCount();
+  bnodecnt = BTreeIndex::getNodeReadCount();
+  bprefetch = PageFile::getPagePrefetchCount();
+  bstats = BufferPool::instance().getStats();
+  if (ring != NULL) bring = ring->getStats();
   SqlEngine::select(attr, table, conds);
-  etime = times(&tmsbuf);
+  gettimeofday(&etime, NULL);
   epagecnt = PageFile::getPageReadCount();
+  enodecnt = BTreeIndex::getNodeReadCount();
+  eprefetch = PageFile::getPagePrefetchCount();
+  estats = BufferPool::instance().getStats();
+  if (ring != NULL) ering = ring->getStats();
+
+  fprintf(stderr, "  -- %.3f seconds to run the select command. Read %d pages\n", (etime.tv_sec - btime.tv_sec) + (etime.tv_usec - btime.tv_usec) / 1e6, epagecnt - bpagecnt);
+  fprintf(stderr, "  -- buffer pool: %ld hits, %ld misses, %ld evictions\n", estats.hits - bstats.hits, estats.misses - bstats.misses, estats.evictions - bstats.evictions);
+  if (enodecnt > bnodecnt) {
+    fprintf(stderr, "  -- index: %d nodes read, %d pages read ahead\n", enodecnt - bnodecnt, eprefetch - bprefetch);
+  }
+  if (ering.requests > bring.requests) {
+    fprintf(stderr, "  -- io_uring: %ld requests in %ld calls, up to %ld in flight\n", ering.requests - bring.requests, ering.calls - bring.calls, ering.maxDepth);
+  }
+}
 
-  fprintf(stderr, "  -- %.3f seconds to run the select command. Read %d pages\n", ((float)(etime - btime))/sysconf(_SC_CLK_TCK), epagecnt - bpagecnt);
+static void runLoad(const char* table, const char* loadfile, bool index)
+{
+  struct timeval btime, etime;
+  int     bpagecnt, epagecnt;
+  int     rows;
+  double  secs;
+
+  // loads are timed with gettimeofday(), because times() counts in
+  // clock ticks, which are too coarse for the rate of a small load
+  gettimeofday(&btime, NULL);
+  bpagecnt = PageFile::getPageWriteCount();
+  if (SqlEngine::load(table, loadfile, index, rows) < 0) return;
+  gettimeofday(&etime, NULL);
+  epagecnt = PageFile::getPageWriteCount();
+
+  secs = (etime.tv_sec - btime.tv_sec) + (etime.tv_usec - btime.tv_usec) / 1e6;
+  fprintf(stderr, "  -- %.3f seconds to load %d tuples (%.0f tuples/sec). Wrote %d pages\n", secs, rows, secs > 0 ? rows / secs : 0.0, epagecnt - bpagecnt);
 }
 
 
@@ -178,7 +224,7 @@ static void runSelect(int attr, const char* table, const std::vector<SelCond>& c
 
 #if ! defined YYSTYPE && ! defined YYSTYPE_IS_DECLARED
 typedef union YYSTYPE
-#line 32 "SqlParser.y"
+#line 78 "SqlParser.y"
 {
   int integer;
   char* string;
@@ -186,7 +232,7 @@ typedef union YYSTYPE
   std::vector<SelCond>* conds;
 }
 /* Line 187 of yacc.c.  */
-#line 190 "SqlParser.tab.c"
+#line 236 "SqlParser.tab.c"
 	YYSTYPE;
 # define yystype YYSTYPE /* obsolescent; will be withdrawn */
 # define YYSTYPE_IS_DECLARED 1
@@ -199,7 +245,7 @@ typedef union YYSTYPE
 
 
 /* Line 216 of yacc.c.  */
-#line 203 "SqlParser.tab.c"
+#line 249 "SqlParser.tab.c"
 
 #ifdef short
 # undef short
@@ -1421,50 +1467,50 @@ yyreduce:
   switch (yyn)
     {
         case 4:
-#line 56 "SqlParser.y"
+#line 102 "SqlParser.y"
     { fprintf(stdout, "Bruinbase> "); ;}
     break;
 
   case 5:
-#line 57 "SqlParser.y"
+#line 103 "SqlParser.y"
     { fprintf(stdout, "Bruinbase> "); ;}
     break;
 
   case 7:
-#line 59 "SqlParser.y"
+#line 105 "SqlParser.y"
     { fprintf(stdout, "Bruinbase> "); ;}
     break;
 
   case 8:
-#line 60 "SqlParser.y"
+#line 106 "SqlParser.y"
     { fprintf(stdout, "Bruinbase> "); ;}
     break;
 
   case 9:
-#line 64 "SqlParser.y"
+#line 110 "SqlParser.y"
     { return 0; ;}
     break;
 
   case 10:
-#line 68 "SqlParser.y"
+#line 114 "SqlParser.y"
     { 
-	  SqlEngine::load(std::string((yyvsp[(2) - (5)].string)), std::string((yyvsp[(4) - (5)].string)), false); 
+	  runLoad((yyvsp[(2) - (5)].string), (yyvsp[(4) - (5)].string), false);
 	  free((yyvsp[(2) - (5)].string));
 	  free((yyvsp[(4) - (5)].string));
 	;}
     break;
 
   case 11:
-#line 73 "SqlParser.y"
+#line 119 "SqlParser.y"
     { 
-	  SqlEngine::load(std::string((yyvsp[(2) - (7)].string)), std::string((yyvsp[(4) - (7)].string)), true); 
+	  runLoad((yyvsp[(2) - (7)].string), (yyvsp[(4) - (7)].string), true);
 	  free((yyvsp[(2) - (7)].string));
 	  free((yyvsp[(4) - (7)].string));
 	;}
     break;
 
   case 12:
-#line 81 "SqlParser.y"
+#line 127 "SqlParser.y"
     {
    	        std::vector<SelCond> conds;
 		runSelect((yyvsp[(2) - (5)].integer), (yyvsp[(4) - (5)].string), conds);
@@ -1473,7 +1519,7 @@ yyreduce:
     break;
 
   case 13:
-#line 86 "SqlParser.y"
+#line 132 "SqlParser.y"
     {
 	        runSelect((yyvsp[(2) - (7)].integer), (yyvsp[(4) - (7)].string), *(yyvsp[(6) - (7)].conds));
 	  	free((yyvsp[(4) - (7)].string));
@@ -1485,7 +1531,7 @@ yyreduce:
     break;
 
   case 14:
-#line 97 "SqlParser.y"
+#line 143 "SqlParser.y"
     {
 	  std::vector<SelCond>* v = new std::vector<SelCond>;
 	  v->push_back(*(yyvsp[(1) - (1)].cond));
@@ -1495,7 +1541,7 @@ yyreduce:
     break;
 
   case 15:
-#line 103 "SqlParser.y"
+#line 149 "SqlParser.y"
     {
 	  (yyvsp[(1) - (3)].conds)->push_back(*(yyvsp[(3) - (3)].cond));
 	  (yyval.conds) = (yyvsp[(1) - (3)].conds);
@@ -1504,7 +1550,7 @@ yyreduce:
     break;
 
   case 16:
-#line 111 "SqlParser.y"
+#line 157 "SqlParser.y"
     { 
 	  SelCond* c = new SelCond;
 	  c->attr = (yyvsp[(1) - (3)].integer);
@@ -1515,22 +1561,22 @@ yyreduce:
     break;
 
   case 17:
-#line 121 "SqlParser.y"
+#line 167 "SqlParser.y"
     { (yyval.integer) = (yyvsp[(1) - (1)].integer); ;}
     break;
 
   case 18:
-#line 122 "SqlParser.y"
+#line 168 "SqlParser.y"
     { (yyval.integer) = 3; ;}
     break;
 
   case 19:
-#line 123 "SqlParser.y"
+#line 169 "SqlParser.y"
     { (yyval.integer) = 4; ;}
     break;
 
   case 20:
-#line 127 "SqlParser.y"
+#line 173 "SqlParser.y"
     { 
 		if (strcasecmp((yyvsp[(1) - (1)].string), "key") == 0) (yyval.integer)=1;
 		else if (strcasecmp((yyvsp[(1) - (1)].string), "value") == 0) (yyval.integer)=2;
@@ -1540,53 +1586,53 @@ yyreduce:
     break;
 
   case 21:
-#line 135 "SqlParser.y"
+#line 181 "SqlParser.y"
     { (yyval.string) = (yyvsp[(1) - (1)].string); ;}
     break;
 
   case 22:
-#line 136 "SqlParser.y"
+#line 182 "SqlParser.y"
     { (yyval.string) = (yyvsp[(1) - (1)].string); ;}
     break;
 
   case 23:
-#line 140 "SqlParser.y"
+#line 186 "SqlParser.y"
     { (yyval.string) = (yyvsp[(1) - (1)].string); ;}
     break;
 
   case 24:
-#line 144 "SqlParser.y"
+#line 190 "SqlParser.y"
     { (yyval.integer) = SelCond::EQ; ;}
     break;
 
   case 25:
-#line 145 "SqlParser.y"
+#line 191 "SqlParser.y"
     { (yyval.integer) = SelCond::NE; ;}
     break;
 
   case 26:
-#line 146 "SqlParser.y"
+#line 192 "SqlParser.y"
     { (yyval.integer) = SelCond::LT; ;}
     break;
 
   case 27:
-#line 147 "SqlParser.y"
+#line 193 "SqlParser.y"
     { (yyval.integer) = SelCond::GT; ;}
     break;
 
   case 28:
-#line 148 "SqlParser.y"
+#line 194 "SqlParser.y"
     { (yyval.integer) = SelCond::LE; ;}
     break;
 
   case 29:
-#line 149 "SqlParser.y"
+#line 195 "SqlParser.y"
     { (yyval.integer) = SelCond::GE; ;}
     break;
 
 
 /* Line 1267 of yacc.c.  */
-#line 1590 "SqlParser.tab.c"
+#line 1636 "SqlParser.tab.c"
       default: break;
     }
   YY_SYMBOL_PRINT ("-> $$ =", yyr1[yyn], &yyval, &yyloc);
@@ -2,11 +2,16 @@
 #include <cstdio>
 #include <cstring>
 #include <sys/times.h>
+#include <sys/time.h>
+#include <unistd.h>
 #include <climits>
 #include <string>
 #include "Bruinbase.h"
 #include "SqlEngine.h" 
 #include "PageFile.h"
+#include "BufferPool.h"
+#include "BTreeIndex.h"
+#include "IoRing.h"
 
 int  sqllex(void);  
 void sqlerror(const char *str) { fprintf(stderr, "Error: %s\n", str); }
@@ -14,17 +19,58 @@ extern "C" { int  sqlwrap() { return 1; } }
 
 static void runSelect(int attr, const char* table, const std::vector<SelCond>& conds)
 {
-  struct tms tmsbuf;
-  clock_t btime, etime;
+  struct timeval btime, etime;
   int     bpagecnt, epagecnt;
-
-  btime = times(&tmsbuf);
+  int     bnodecnt, enodecnt;
+  int     bprefetch, eprefetch;
+  BufferPool::Stats bstats, estats;
+  IoRing::Stats bring, ering;
+  IoRing* ring = PageFile::getAsyncIO() ? IoRing::instance() : NULL;
+
+  memset(&bring, 0, sizeof(bring));
+  memset(&ering, 0, sizeof(ering));
+  // timed like loads, so that a short scan does not read as 0 seconds
+  gettimeofday(&btime, NULL);
   bpagecnt = PageFile::getPageReadCount();
+  bnodecnt = BTreeIndex::getNodeReadCount();
+  bprefetch = PageFile::getPagePrefetchCount();
+  bstats = BufferPool::instance().getStats();
+  if (ring != NULL) bring = ring->getStats();
   SqlEngine::select(attr, table, conds);
-  etime = times(&tmsbuf);
+  gettimeofday(&etime, NULL);
   epagecnt = PageFile::getPageReadCount();
+  enodecnt = BTreeIndex::getNodeReadCount();
+  eprefetch = PageFile::getPagePrefetchCount();
+  estats = BufferPool::instance().getStats();
+  if (ring != NULL) ering = ring->getStats();
+
+  fprintf(stderr, "  -- %.3f seconds to run the select command. Read %d pages\n", (etime.tv_sec - btime.tv_sec) + (etime.tv_usec - btime.tv_usec) / 1e6, epagecnt - bpagecnt);
+  fprintf(stderr, "  -- buffer pool: %ld hits, %ld misses, %ld evictions\n", estats.hits - bstats.hits, estats.misses - bstats.misses, estats.evictions - bstats.evictions);
+  if (enodecnt > bnodecnt) {
+    fprintf(stderr, "  -- index: %d nodes read, %d pages read ahead\n", enodecnt - bnodecnt, eprefetch - bprefetch);
+  }
+  if (ering.requests > bring.requests) {
+    fprintf(stderr, "  -- io_uring: %ld requests in %ld calls, up to %ld in flight\n", ering.requests - bring.requests, ering.calls - bring.calls, ering.maxDepth);
+  }
+}
 
-  fprintf(stderr, "  -- %.3f seconds to run the select command. Read %d pages\n", ((float)(etime - btime))/sysconf(_SC_CLK_TCK), epagecnt - bpagecnt);
+static void runLoad(const char* table, const char* loadfile, bool index)
+{
+  struct timeval btime, etime;
+  int     bpagecnt, epagecnt;
+  int     rows;
+  double  secs;
+
+  // loads are timed with gettimeofday(), because times() counts in
+  // clock ticks, which are too coarse for the rate of a small load
+  gettimeofday(&btime, NULL);
+  bpagecnt = PageFile::getPageWriteCount();
+  if (SqlEngine::load(table, loadfile, index, rows) < 0) return;
+  gettimeofday(&etime, NULL);
+  epagecnt = PageFile::getPageWriteCount();
+
+  secs = (etime.tv_sec - btime.tv_sec) + (etime.tv_usec - btime.tv_usec) / 1e6;
+  fprintf(stderr, "  -- %.3f seconds to load %d tuples (%.0f tuples/sec). Wrote %d pages\n", secs, rows, secs > 0 ? rows / secs : 0.0, epagecnt - bpagecnt);
 }
 
 %}
@@ -66,12 +112,12 @@ quit_command:
 
 load_command:
 	LOAD table FROM STRING LF { 
-	  SqlEngine::load(std::string($2), std::string($4), false); 
+	  runLoad($2, $4, false);
 	  free($2);
 	  free($4);
 	}
 	| LOAD table FROM STRING WITH INDEX LF { 
-	  SqlEngine::load(std::string($2), std::string($4), true); 
+	  runLoad($2, $4, true);
 	  free($2);
 	  free($4);
 	}
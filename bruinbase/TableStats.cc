@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <map>
+#include <algorithm>
+#include <sys/stat.h>
+#include "TableStats.h"
+
+using namespace std;
+
+static const int STAT_MAGIC = 0x54535242;  // "BRST"
+static const int STAT_VERSION = 1;
+
+// the statistics read from the stat files, with the modification time
+// of the file they were read from
+struct CachedStats {
+  TableStats stats;
+  time_t     mtime;
+};
+static map<string, CachedStats> cache;
+
+// a 64-bit hash of a string: FNV-1a, followed by a final mix so that
+// the high bits, which pick the HyperLogLog register, are well spread
+unsigned long long TableStats::hash(const char* value, int length)
+{
+  unsigned long long h = 14695981039346656037ULL;
+  for (int i = 0; i < length; i++) {
+    h ^= (unsigned char)value[i];
+    h *= 1099511628211ULL;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+TableStats::TableStats()
+{
+  rowCount = 0;
+  minKey = maxKey = 0;
+  valueBytes = 0;
+  memset(hll, 0, sizeof(hll));
+  random = 88172645463325252ULL;
+}
+
+void TableStats::addHashed(int key, int length, unsigned long long h)
+{
+  if (rowCount == 0 || key < minKey) minKey = key;
+  if (rowCount == 0 || key > maxKey) maxKey = key;
+  rowCount++;
+  valueBytes += length;
+
+  // the register is picked by the high bits of the hash and records the
+  // longest run of leading zeros seen in the rest
+  int r = h >> (64 - HLL_BITS);
+  unsigned long long rest = h << HLL_BITS;
+  unsigned char zeros = (rest == 0) ? 64 - HLL_BITS + 1 : __builtin_clzll(rest) + 1;
+  if (zeros > hll[r]) hll[r] = zeros;
+
+  // reservoir sampling: the n-th key replaces a random sampled key with
+  // probability SAMPLE_SIZE / n, so every key is sampled equally likely
+  if ((int)sample.size() < SAMPLE_SIZE) {
+    sample.push_back(key);
+    return;
+  }
+  random ^= random << 13;
+  random ^= random >> 7;
+  random ^= random << 17;
+  unsigned long long slot = random % rowCount;
+  if (slot < (unsigned long long)SAMPLE_SIZE) sample[slot] = key;
+}
+
+void TableStats::buildHistogram()
+{
+  vector<int> sorted(sample);
+  sort(sorted.begin(), sorted.end());
+
+  // bounds[i] is the smallest key of bucket i. the last bound is the
+  // largest key, which the sample may have missed, like the smallest one
+  bounds.clear();
+  int n = sorted.size();
+  int buckets = (n < HISTOGRAM_BUCKETS) ? n : HISTOGRAM_BUCKETS;
+  for (int i = 0; i < buckets; i++) {
+    bounds.push_back(sorted[(long)n * i / buckets]);
+  }
+  if (buckets > 0) {
+    bounds[0] = minKey;
+    bounds.push_back(maxKey);
+  }
+}
+
+RC TableStats::read(const string& table)
+{
+  FILE* fp;
+  int   magic, version, n;
+  long long rows;
+  RC    rc = RC_INVALID_FILE_FORMAT;
+
+  if ((fp = fopen((table + ".stat").c_str(), "rb")) == NULL) return RC_FILE_OPEN_FAILED;
+
+  if (fread(&magic, sizeof(int), 1, fp) != 1 || magic != STAT_MAGIC) goto exit_read;
+  if (fread(&version, sizeof(int), 1, fp) != 1 || version != STAT_VERSION) goto exit_read;
+  if (fread(&rows, sizeof(rows), 1, fp) != 1) goto exit_read;
+  if (fread(&minKey, sizeof(int), 1, fp) != 1) goto exit_read;
+  if (fread(&maxKey, sizeof(int), 1, fp) != 1) goto exit_read;
+  if (fread(&valueBytes, sizeof(double), 1, fp) != 1) goto exit_read;
+  if (fread(hll, 1, HLL_REGISTERS, fp) != (size_t)HLL_REGISTERS) goto exit_read;
+  if (fread(&n, sizeof(int), 1, fp) != 1 || n < 0 || n > SAMPLE_SIZE) goto exit_read;
+  sample.resize(n);
+  if (n > 0 && fread(&sample[0], sizeof(int), n, fp) != (size_t)n) goto exit_read;
+  if (fread(&n, sizeof(int), 1, fp) != 1 || n < 0 || n > HISTOGRAM_BUCKETS + 1) goto exit_read;
+  bounds.resize(n);
+  if (n > 0 && fread(&bounds[0], sizeof(int), n, fp) != (size_t)n) goto exit_read;
+  rowCount = rows;
+  rc = 0;
+
+exit_read:
+  fclose(fp);
+  return rc;
+}
+
+RC TableStats::write(const string& table)
+{
+  FILE* fp;
+  int   n;
+  long long rows = rowCount;
+  bool  ok;
+
+  buildHistogram();
+
+  if ((fp = fopen((table + ".stat").c_str(), "wb")) == NULL) return RC_FILE_OPEN_FAILED;
+
+  ok = fwrite(&STAT_MAGIC, sizeof(int), 1, fp) == 1 &&
+       fwrite(&STAT_VERSION, sizeof(int), 1, fp) == 1 &&
+       fwrite(&rows, sizeof(rows), 1, fp) == 1 &&
+       fwrite(&minKey, sizeof(int), 1, fp) == 1 &&
+       fwrite(&maxKey, sizeof(int), 1, fp) == 1 &&
+       fwrite(&valueBytes, sizeof(double), 1, fp) == 1 &&
+       fwrite(hll, 1, HLL_REGISTERS, fp) == (size_t)HLL_REGISTERS;
+  n = sample.size();
+  ok = ok && fwrite(&n, sizeof(int), 1, fp) == 1 &&
+       (n == 0 || fwrite(&sample[0], sizeof(int), n, fp) == (size_t)n);
+  n = bounds.size();
+  ok = ok && fwrite(&n, sizeof(int), 1, fp) == 1 &&
+       (n == 0 || fwrite(&bounds[0], sizeof(int), n, fp) == (size_t)n);
+
+  if (fclose(fp) != 0) ok = false;
+
+  // the cached copy is out of date
+  cache.erase(table);
+  return ok ? 0 : RC_FILE_WRITE_FAILED;
+}
+
+const TableStats* TableStats::get(const string& table)
+{
+  struct stat statbuf;
+
+  if (::stat((table + ".stat").c_str(), &statbuf) < 0) {
+    cache.erase(table);
+    return NULL;
+  }
+
+  map<string, CachedStats>::iterator it = cache.find(table);
+  if (it != cache.end() && it->second.mtime == statbuf.st_mtime) {
+    return &it->second.stats;
+  }
+
+  CachedStats entry;
+  if (entry.stats.read(table) < 0) {
+    cache.erase(table);
+    return NULL;
+  }
+  entry.mtime = statbuf.st_mtime;
+  return &(cache[table] = entry).stats;
+}
+
+double TableStats::getAvgValueLength() const
+{
+  return (rowCount > 0) ? valueBytes / rowCount : 0;
+}
+
+double TableStats::getDistinctValues() const
+{
+  const double m = HLL_REGISTERS;
+  double sum = 0;
+  int empty = 0;
+
+  for (int i = 0; i < HLL_REGISTERS; i++) {
+    sum += ldexp(1.0, -hll[i]);
+    if (hll[i] == 0) empty++;
+  }
+
+  // the raw estimate is biased for small counts. linear counting
+  // over the empty registers is used there instead
+  double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+  if (estimate <= 2.5 * m && empty > 0) estimate = m * log(m / empty);
+
+  return (estimate < rowCount) ? estimate : rowCount;
+}
+
+double TableStats::fractionBelow(long long key) const
+{
+  int buckets = (int)bounds.size() - 1;
+  if (buckets <= 0) return (key > minKey) ? 1 : 0;
+
+  // every bucket holds the same share of the tuples
+  double below = 0;
+  for (int i = 0; i < buckets; i++) {
+    long long lo = bounds[i];
+    long long hi = bounds[i + 1];
+    if (key > hi) below += 1;
+    else if (key > lo) below += (double)(key - lo) / (hi - lo + 1);
+  }
+  return below / buckets;
+}
+
+double TableStats::estimateKeyRange(long long lo, long long hi) const
+{
+  if (rowCount == 0 || lo > hi) return 0;
+  return rowCount * (fractionBelow(hi + 1) - fractionBelow(lo));
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef TABLESTATS_H
+#define TABLESTATS_H
+
+#include <string>
+#include <vector>
+#include "Bruinbase.h"
+
+/**
+ * Statistics of a table, kept in the file "table.stat" next to the
+ * table and built by LOAD while it appends the tuples:
+ * the row count, the key range, an equi-depth histogram of the keys,
+ * a HyperLogLog sketch of the distinct values and the average value length.
+ * The histogram is computed from a uniform sample of the keys, which is
+ * stored in the file so that a later LOAD into the same table can
+ * continue it.
+ */
+class TableStats {
+ public:
+  static const int SAMPLE_SIZE = 4096;       // keys kept for the histogram
+  static const int HISTOGRAM_BUCKETS = 32;
+  static const int HLL_BITS = 10;            // the sketch has 2^HLL_BITS
+  static const int HLL_REGISTERS = 1 << HLL_BITS;  // registers
+
+  TableStats();
+
+  /**
+   * add a tuple to the statistics.
+   * @param key[IN] the key of the tuple
+   * @param value[IN] the value of the tuple
+   */
+  void add(int key, const std::string& value) { add(key, value.data(), value.size()); }
+
+  /**
+   * add a tuple whose value is not NUL-terminated.
+   * @param key[IN] the key of the tuple
+   * @param value[IN] the value of the tuple
+   * @param length[IN] the length of the value
+   */
+  void add(int key, const char* value, int length) { addHashed(key, length, hash(value, length)); }
+
+  /**
+   * add a tuple whose value was hashed with hash() beforehand, e.g. by
+   * the threads that parse a load file.
+   * @param key[IN] the key of the tuple
+   * @param length[IN] the length of the value
+   * @param h[IN] the hash of the value
+   */
+  void addHashed(int key, int length, unsigned long long h);
+
+  /**
+   * @param value[IN] a value
+   * @param length[IN] the length of the value
+   * @return the hash of the value that the distinct count is kept from
+   */
+  static unsigned long long hash(const char* value, int length);
+
+  /**
+   * read the statistics of a table from its stat file.
+   * @param table[IN] the table name
+   * @return error code. 0 if no error
+   */
+  RC read(const std::string& table);
+
+  /**
+   * write the statistics of a table to its stat file.
+   * @param table[IN] the table name
+   * @return error code. 0 if no error
+   */
+  RC write(const std::string& table);
+
+  /**
+   * the statistics of a table, read from its stat file at the first call
+   * and cached. the file is read again after it changes.
+   * @param table[IN] the table name
+   * @return the statistics. NULL if the table has no stat file
+   */
+  static const TableStats* get(const std::string& table);
+
+  /**
+   * @return the number of tuples
+   */
+  long getRowCount() const { return rowCount; }
+
+  /**
+   * @return the smallest key. undefined if there are no tuples
+   */
+  int getMinKey() const { return minKey; }
+
+  /**
+   * @return the largest key. undefined if there are no tuples
+   */
+  int getMaxKey() const { return maxKey; }
+
+  /**
+   * @return the average length of the values
+   */
+  double getAvgValueLength() const;
+
+  /**
+   * @return the estimated number of distinct values
+   */
+  double getDistinctValues() const;
+
+  /**
+   * estimate the number of tuples with lo <= key <= hi from the histogram.
+   * keys are assumed to be spread evenly inside a bucket.
+   * @param lo[IN] the smallest key of the range
+   * @param hi[IN] the largest key of the range
+   * @return the estimated number of tuples
+   */
+  double estimateKeyRange(long long lo, long long hi) const;
+
+ private:
+  // the fraction of the tuples whose key is smaller than key
+  double fractionBelow(long long key) const;
+
+  // compute the histogram bounds from the sample
+  void buildHistogram();
+
+  long   rowCount;     // # of tuples
+  int    minKey;       // the key range
+  int    maxKey;
+  double valueBytes;   // total length of the values
+
+  std::vector<int> sample;            // uniform sample of the keys
+  std::vector<int> bounds;            // equi-depth histogram of the keys
+  unsigned char hll[HLL_REGISTERS];   // HyperLogLog sketch of the values
+  unsigned long long random;          // state of the sampling generator
+};
+
+#endif // TABLESTATS_H
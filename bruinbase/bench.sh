@@ -0,0 +1,241 @@
+#!/bin/sh
+#
+# Benchmarks for bruinbase. Each benchmark builds its own tables from
+# copies of movie.del (with the keys shifted so that they stay unique)
+# in a scratch directory and prints the numbers reported by the engine.
+#
+# usage: sh bench.sh pagesize|fanout|load|threads|lookup|direct|io_uring [copies]
+#   pagesize  load the data with 1KB..64KB pages and compare the page
+#             reads and the run time of the same SELECT statements
+#   fanout    build the index with 1KB..64KB pages and compare the tree
+#             height and the page reads of point and range lookups
+#   load      time LOAD ... WITH INDEX and the range scans over the
+#             resulting index with several node fill factors
+#   threads   time LOAD and LOAD ... WITH INDEX with 1, 2, 4 and 8
+#             parser threads (-j). the tuples are still appended, and
+#             the index entries sorted, by one thread
+#   lookup    run 1000 point lookups through the index in one process
+#             and count the pages each of them touches in the pool
+#   direct    run table scans with and without O_DIRECT (-d) over 1KB..
+#             16KB pages, check that both return the same rows, and show
+#             how the plan says the pages are read. exits with 1 if the
+#             rows differ or no page size is read with O_DIRECT
+#   io_uring  run the same index range scans with the leaves read ahead
+#             synchronously and through io_uring (-u), and compare the
+#             pages read per second. each scan runs in a fresh process,
+#             so the buffer pool is cold, but the kernel page cache is
+#             not: this measures the cost of the read calls, not of the
+#             disk. with COLD=1 (as root), the kernel page cache is
+#             dropped before every run, so the pages come from the disk
+#
+
+BIN=${BIN:-`pwd`/bruinbase}
+DATA=`pwd`/movie.del
+
+# gen_data <copies> <file>: write a movie.del-shaped load file
+gen_data()
+{
+  awk -v copies="$1" '
+    { key[NR] = substr($0, 1, index($0, ",") - 1); val[NR] = substr($0, index($0, ",")) }
+    END { for (c = 0; c < copies; c++) for (i = 1; i <= NR; i++) print key[i] + c * 5000 val[i] }
+  ' "$DATA" > "$2"
+}
+
+# report <label> <bruinbase options>: run the statement on stdin in a
+# fresh process (cold buffer pool) and print its time and page reads
+report()
+{
+  label=$1; shift
+  "$BIN" "$@" 2>&1 >/dev/null | grep "seconds to run" |
+    awk -v q="$label" '{ printf "  %-56s %6s s %7d pages\n", q, $2, $(NF-1) }'
+}
+
+SELECTS="select count(*) from t
+select count(*) from t where key > 1000 and key < 2000
+select * from t where key = 2342
+select count(*) from t where value = 'Bananas'"
+
+bench_pagesize()
+{
+  copies=${1:-20}
+  gen_data "$copies" data.del
+  echo "rows: `wc -l < data.del`"
+
+  for size in 1024 4096 8192 16384 65536; do
+    rm -f t.tbl t.idx t.stat
+    echo "load t from 'data.del'" | "$BIN" -p $size > /dev/null 2>&1
+    echo "page size $size: `wc -c < t.tbl` bytes"
+    # the page size is read from the file header, no option needed
+    echo "$SELECTS" | while read q; do
+      echo "$q" | report "$q"
+    done
+  done
+}
+
+INDEX_SELECTS="select * from t where key = 52342
+select count(*) from t where key > 33000 and key < 34000
+select count(*) from t where key > 10000 and key < 60000"
+
+bench_fanout()
+{
+  copies=${1:-20}
+  gen_data "$copies" data.del
+  echo "rows: `wc -l < data.del`"
+
+  for size in 1024 4096 8192 16384 65536; do
+    rm -f t.tbl t.idx t.stat
+    echo "load t from 'data.del' with index" | "$BIN" -p $size > /dev/null 2>&1
+    # (rootPid, treeHeight) are the first two words of the first data
+    # page, which follows the page-sized file header
+    height=`od -An -tu4 -j $size -N 8 t.idx | awk '{ print $2 }'`
+    echo "page size $size: height $height, `wc -c < t.idx` index bytes"
+    echo "$INDEX_SELECTS" | while read q; do
+      echo "$q" | report "$q"
+    done
+  done
+}
+
+bench_load()
+{
+  copies=${1:-20}
+  gen_data "$copies" data.del
+  echo "rows: `wc -l < data.del`"
+
+  for fill in 100 90 70; do
+    rm -f t.tbl t.idx t.stat
+    echo "fill $fill%:"
+    echo "load t from 'data.del' with index" | "$BIN" -f $fill 2>&1 >/dev/null |
+      grep "to load" | sed 's/^  -- /  /'
+    echo "  `wc -c < t.idx` index bytes"
+    echo "select count(*) from t where key > 10000 and key < 60000" |
+      report "range scan"
+  done
+}
+
+bench_threads()
+{
+  copies=${1:-300}
+  gen_data "$copies" data.del
+  echo "rows: `wc -l < data.del`, cpus: `getconf _NPROCESSORS_ONLN`"
+
+  for index in "" " with index"; do
+    echo "load t from 'data.del'$index:"
+    for j in 1 2 4 8; do
+      rm -f t.tbl t.idx t.stat
+      echo "load t from 'data.del'$index" | "$BIN" -j $j 2>&1 >/dev/null |
+        grep "to load" | awk -v j=$j '{ printf "  -j %d  %6s s %9s tuples/s\n", j, $2, substr($8, 2) }'
+    done
+  done
+}
+
+bench_lookup()
+{
+  copies=${1:-20}
+  gen_data "$copies" data.del
+  echo "rows: `wc -l < data.del`"
+
+  rm -f t.tbl t.idx t.stat
+  echo "load t from 'data.del' with index" | "$BIN" > /dev/null 2>&1
+  # every n-th key of the load file, 1000 lookups in total
+  awk -F, -v n=$((copies * 3616 / 1000)) 'NR % n == 0 && ++c <= 1000 {
+    print "select * from t where key = " $1 }' data.del > lookups.sql
+  "$BIN" < lookups.sql 2>&1 >/dev/null | awk '
+    /buffer pool:/ { q++; hits += $4; misses += $6 }
+    END { printf "  %d lookups: %.2f pages touched, %.2f read from disk per lookup\n",
+                 q, (hits + misses) / q, misses / q }'
+}
+
+DIRECT_SELECTS="select count(*) from t where value = 'Bananas'
+select * from t where value > 'W'
+select key from t where key > 40000 and value < 'C'"
+
+bench_direct()
+{
+  copies=${1:-20}
+  gen_data "$copies" data.del
+  echo "rows: `wc -l < data.del`"
+
+  status=0
+  used=0
+  echo "$DIRECT_SELECTS" > scans.sql
+  for size in 1024 4096 16384; do
+    rm -f t.tbl t.idx t.stat
+    echo "load t from 'data.del'" | "$BIN" -p $size > /dev/null 2>&1
+    how=`head -1 scans.sql | "$BIN" -d 2>&1 >/dev/null | grep -e "-- scan:" | sed 's/^  -- scan: //'`
+    echo "page size $size: $how"
+    case "$how" in "O_DIRECT reads") used=1 ;; esac
+
+    while read q; do
+      echo "$q" | "$BIN" > cached.out 2>/dev/null
+      echo "$q" | "$BIN" -d > direct.out 2>/dev/null
+      if ! cmp -s cached.out direct.out; then
+        echo "  different rows with -d: $q"
+        status=1
+      fi
+      echo "$q" | report "$q"
+      echo "$q" | report "$q (-d)" -d
+    done < scans.sql
+  done
+
+  if [ $used = 0 ]; then
+    echo "O_DIRECT was not used for any page size"
+    status=1
+  fi
+  return $status
+}
+
+RANGE_SELECTS="select key from t where key > 0 and key < 1500000
+select key from t where key > 300000 and key < 600000
+select * from t where key > 0 and key < 100000"
+
+# rate <label> <bruinbase options>: run the statement on stdin three
+# times and print the best time, the pages read per second and, with
+# io_uring, the most requests that were in flight together
+rate()
+{
+  label=$1; shift
+  sql=`cat`
+  for i in 1 2 3; do
+    if [ -n "$COLD" ]; then sync; echo 3 > /proc/sys/vm/drop_caches; fi
+    echo "$sql" | "$BIN" "$@" 2>&1 >/dev/null | grep -e "seconds to run" -e "io_uring:"
+  done | awk -v q="$label" '
+    /seconds to run/ { if (best == "" || $2 < best) best = $2; pages = $(NF-1) }
+    /io_uring:/ { if ($(NF-2) > depth) depth = $(NF-2) }
+    END { r = (best > 0) ? sprintf("%d", pages / best) : "-"
+          printf "  %-24s %6s s %7d pages %9s pages/s", q, best, pages, r
+          if (depth != "") printf ", up to %d in flight", depth
+          printf "\n" }'
+}
+
+bench_io_uring()
+{
+  copies=${1:-300}
+  gen_data "$copies" data.del
+  echo "rows: `wc -l < data.del`"
+
+  rm -f t.tbl t.idx t.stat
+  echo "load t from 'data.del' with index" | "$BIN" > /dev/null 2>&1
+  echo "$RANGE_SELECTS" > scans.sql
+  while read q; do
+    echo "$q"
+    for ahead in 8 64; do
+      echo "$q" | rate "read-ahead $ahead" -r $ahead
+      echo "$q" | rate "read-ahead $ahead, -u" -r $ahead -u
+    done
+  done < scans.sql
+}
+
+dir=`mktemp -d`
+trap 'rm -rf "$dir"' 0
+cd "$dir"
+
+case "$1" in
+pagesize) shift; bench_pagesize "$@" ;;
+fanout) shift; bench_fanout "$@" ;;
+load) shift; bench_load "$@" ;;
+threads) shift; bench_threads "$@" ;;
+lookup) shift; bench_lookup "$@" ;;
+direct) shift; bench_direct "$@" ;;
+io_uring) shift; bench_io_uring "$@" ;;
+*) echo "usage: sh bench.sh pagesize|fanout|load|threads|lookup|direct|io_uring [copies]" >&2; exit 1 ;;
+esac
@@ -7,11 +7,76 @@
  * @date 3/24/2008
  */
  
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
 #include "Bruinbase.h"
 #include "SqlEngine.h"
+#include "BufferPool.h"
+#include "PageFile.h"
+#include "BTreeIndex.h"
+#include "RecordFile.h"
+#include "LoadPipeline.h"
 
-int main()
+static void usage(const char* prog)
 {
+  fprintf(stderr, "usage: %s [-b buffer_pool_MB] [-p page_size] [-f fill_percent] [-r read_ahead_leaves] [-m] [-d] [-u] [-j load_threads] [-s] [-z]\n", prog);
+  exit(1);
+}
+
+int main(int argc, char* argv[])
+{
+  int c;
+
+  // parse the command line options
+  while ((c = getopt(argc, argv, "b:p:f:r:mduj:sz")) != -1) {
+    switch (c) {
+    case 'b':
+      // size of the buffer pool shared by all open files
+      if (BufferPool::configure(atoi(optarg)) < 0) usage(argv[0]);
+      break;
+    case 'p':
+      // page size of the table and index files created from now on
+      if (PageFile::setDefaultPageSize(atoi(optarg)) < 0) usage(argv[0]);
+      break;
+    case 'f':
+      // how full LOAD ... WITH INDEX packs the index nodes
+      if (BTreeIndex::setFillPercent(atoi(optarg)) < 0) usage(argv[0]);
+      break;
+    case 'r':
+      // how many leaves index range scans read ahead
+      if (IndexScan::setReadAhead(atoi(optarg)) < 0) usage(argv[0]);
+      break;
+    case 'm':
+      // read tables and indexes opened for queries through mmap
+      PageFile::setMemoryMap(true);
+      break;
+    case 'd':
+      // scan tables with O_DIRECT, bypassing the kernel page cache
+      PageFile::setDirectIO(true);
+      break;
+    case 'u':
+      // read and write batches of pages through io_uring
+      PageFile::setAsyncIO(true);
+      break;
+    case 'j':
+      // how many threads parse the load file of LOAD
+      if (LoadPipeline::setThreads(atoi(optarg)) < 0) usage(argv[0]);
+      break;
+    case 's':
+      // write every page to the disk immediately (no write-back)
+      PageFile::setWriteBack(false);
+      break;
+    case 'z':
+      // keep each distinct value once per page in the tables created
+      // from now on
+      RecordFile::setDefaultLayout(RecordFile::DICTIONARY);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+
   // run the SQL engine taking user commands from standard input (console).
   SqlEngine::run(stdin);
 
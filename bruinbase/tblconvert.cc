@@ -0,0 +1,162 @@
+/**
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+//
+// tblconvert: rewrite tables in the SLOTTED record layout, or with -z in
+// the DICTIONARY layout. the record ids change, so the index of a table
+// is built again. the statistics of a table do not depend on the layout
+// and are kept.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include "Bruinbase.h"
+#include "PageFile.h"
+#include "RecordFile.h"
+#include "BTreeIndex.h"
+#include "IndexSorter.h"
+
+using std::string;
+
+static void usage(const char* prog)
+{
+  fprintf(stderr, "usage: %s [-p page_size] [-z] table...\n", prog);
+  exit(1);
+}
+
+// convert a table. the new files are written next to the old ones and
+// replace them only when they are complete
+static RC convert(const string& table, bool keepPageSize)
+{
+  RecordFile  in, out;
+  RecordScan  scan;
+  IndexSorter sorter;
+  BTreeIndex  idx;
+  RC          rc;
+
+  string tbl = table + ".tbl";
+  string index = table + ".idx";
+  bool   indexed = (access(index.c_str(), F_OK) == 0);
+
+  if ((rc = in.open(tbl, 'r')) < 0) {
+    fprintf(stderr, "Error: cannot open table %s\n", table.c_str());
+    return rc;
+  }
+  if (in.getLayout() == RecordFile::getDefaultLayout()) {
+    fprintf(stderr, "%s: already in the %s layout\n", table.c_str(),
+            in.getLayout() == RecordFile::SLOTTED ? "slotted" : "dictionary");
+    in.close();
+    return 0;
+  }
+
+  // the new table gets the page size of the old one unless -p was given
+  if (keepPageSize) PageFile::setDefaultPageSize(in.getPageSize());
+  unlink((tbl + ".new").c_str());
+  if ((rc = out.open(tbl + ".new", 'w')) < 0) {
+    fprintf(stderr, "Error: cannot create %s.new\n", tbl.c_str());
+    in.close();
+    return rc;
+  }
+
+  // copy the records a batch at a time, and collect the index entries
+  // with the new record ids
+  int  keys[RecordScan::BATCH_SIZE];
+  const char* values[RecordScan::BATCH_SIZE];
+  int  lengths[RecordScan::BATCH_SIZE];
+  int  count;
+  RecordId rid;
+
+  scan.open(in);
+  while ((rc = scan.nextBatch(keys, values, RecordScan::BATCH_SIZE, count)) == 0) {
+    for (int i = 0; i < count; i++) lengths[i] = strlen(values[i]);
+    if ((rc = out.appendMany(keys, values, lengths, count, rid)) < 0) break;
+    for (int i = 0; i < count && indexed; i++, out.next(rid)) {
+      if ((rc = sorter.add(keys[i], rid)) < 0) break;
+    }
+    if (rc < 0) break;
+  }
+  scan.close();
+  if (rc != RC_END_OF_INPUT) {
+    fprintf(stderr, "Error: while copying table %s\n", table.c_str());
+    out.close();
+    in.close();
+    unlink((tbl + ".new").c_str());
+    return rc;
+  }
+
+  int    records = out.getRecordCount();
+  PageId oldPages = in.getPageCount();
+  PageId newPages = 0;
+  in.close();
+  if ((rc = out.flush()) == 0) newPages = out.getPageCount();
+  if (rc < 0 || (rc = out.close()) < 0) {
+    fprintf(stderr, "Error: while writing %s.new\n", tbl.c_str());
+    unlink((tbl + ".new").c_str());
+    return rc;
+  }
+
+  // build the index of the new record ids
+  if (indexed) {
+    unlink((index + ".new").c_str());
+    if ((rc = sorter.sort()) < 0 || (rc = idx.open(index + ".new", 'w')) < 0) {
+      fprintf(stderr, "Error: cannot create %s.new\n", index.c_str());
+      unlink((tbl + ".new").c_str());
+      return rc;
+    }
+    rc = idx.bulkLoad(sorter);
+    RC rc2 = idx.close();
+    if (rc < 0 || rc2 < 0) {
+      fprintf(stderr, "Error: while building the index of table %s\n", table.c_str());
+      unlink((index + ".new").c_str());
+      unlink((tbl + ".new").c_str());
+      return (rc < 0) ? rc : rc2;
+    }
+  }
+
+  if (rename((tbl + ".new").c_str(), tbl.c_str()) < 0 ||
+      (indexed && rename((index + ".new").c_str(), index.c_str()) < 0)) {
+    fprintf(stderr, "Error: cannot replace the files of table %s\n", table.c_str());
+    return RC_FILE_WRITE_FAILED;
+  }
+
+  fprintf(stderr, "%s: %d records, %d pages -> %d pages%s\n", table.c_str(), records,
+          oldPages, newPages, indexed ? ", index rebuilt" : "");
+  return 0;
+}
+
+int main(int argc, char* argv[])
+{
+  int  c;
+  bool keepPageSize = true;
+  int  failed = 0;
+
+  // parse the command line options
+  while ((c = getopt(argc, argv, "p:z")) != -1) {
+    switch (c) {
+    case 'p':
+      // page size of the converted tables and indexes
+      if (PageFile::setDefaultPageSize(atoi(optarg)) < 0) usage(argv[0]);
+      keepPageSize = false;
+      break;
+    case 'z':
+      // keep each distinct value once per page
+      RecordFile::setDefaultLayout(RecordFile::DICTIONARY);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (optind >= argc) usage(argv[0]);
+
+  for (int i = optind; i < argc; i++) {
+    if (convert(argv[i], keepPageSize) < 0) failed++;
+  }
+
+  return failed ? 1 : 0;
+}